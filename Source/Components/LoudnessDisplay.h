@@ -0,0 +1,88 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "RMSMeter.h"
+
+using namespace juce;
+using namespace std;
+
+namespace GUI
+{
+	// BS.1770 loudness, beside the RMS meters: a bar for the momentary loudness on the same scale as
+	// VerticalRMSMeter, a line for the short-term loudness, and the integrated loudness and highest true
+	// peak written underneath. Clicking it clears the true peak
+	class LoudnessDisplay : public Component
+	{
+	public:
+
+		LoudnessDisplay()
+		{
+			bar.setInterceptsMouseClicks(false, false);
+			addAndMakeVisible(bar);
+		}
+
+		// Latest loudness in LUFS and the true peak since the last call in dBTP, from the processor's meter
+		// levels. The readouts are repainted when their text changes; the bar waits for update()
+		void setLevels(float momentaryLoudness, float shortTermLoudness, float integratedLoudness, float truePeak)
+		{
+			const auto peak = jmax(maxTruePeak, truePeak);
+			const auto textChanged = toTenths(momentaryLoudness) != toTenths(momentary) || toTenths(shortTermLoudness) != toTenths(shortTerm)
+									 || toTenths(integratedLoudness) != toTenths(integrated) || toTenths(peak) != toTenths(maxTruePeak);
+
+			momentary		= momentaryLoudness;
+			shortTerm		= shortTermLoudness;
+			integrated		= integratedLoudness;
+			maxTruePeak		= peak;
+
+			if (textChanged)
+				repaint(getTextBounds());
+		}
+
+		// Once per display frame, like VerticalRMSMeter::update()
+		void update()
+		{
+			bar.update();
+		}
+
+		void paint(Graphics& g) override
+		{
+			auto text = getTextBounds().toFloat();
+			const auto lineHeight = text.getHeight() / 4.f;
+
+			g.setFont(15.0f);
+			g.setColour(Colours::white);
+			g.drawText("M  " + formatLevel(momentary),		text.removeFromTop(lineHeight), Justification::centredLeft, false);
+			g.drawText("S  " + formatLevel(shortTerm),		text.removeFromTop(lineHeight), Justification::centredLeft, false);
+			g.drawText("I  " + formatLevel(integrated),		text.removeFromTop(lineHeight), Justification::centredLeft, false);
+
+			// Over the usual -1 dBTP delivery limit
+			g.setColour(maxTruePeak > -1.f ? Colours::red : Colours::white);
+			g.drawText("TP " + formatLevel(maxTruePeak),	text.removeFromTop(lineHeight), Justification::centredLeft, false);
+		}
+
+		void resized() override
+		{
+			bar.setBounds(getBarBounds());
+		}
+
+		void mouseDown(const MouseEvent&) override
+		{
+			maxTruePeak = -100.f;
+			repaint(getTextBounds());
+		}
+
+	private:
+
+		// The bar is as big as a VerticalRMSMeter, at the top left; the readouts fill the rest
+		static constexpr int barWidth = 35, barHeight = 400;
+
+		Rectangle<int> getBarBounds() const		{ return { 0, 0, barWidth, jmin(barHeight, getHeight()) }; }
+		Rectangle<int> getTextBounds() const	{ return getLocalBounds().withTop(getBarBounds().getBottom() + 5); }
+
+		static String formatLevel(float level)	{ return level > -100.f ? String(level, 1) : String("-inf"); }
+		static int toTenths(float level)		{ return roundToInt(jmax(-100.f, level) * 10.f); }
+
+		float momentary{ -100.f }, shortTerm{ -100.f }, integrated{ -100.f }, maxTruePeak{ -100.f };
+		VerticalRMSMeter bar{ [this] { return momentary; }, [this] { return shortTerm; } };
+	};
+}
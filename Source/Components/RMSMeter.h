@@ -1,55 +1,186 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include <BinaryData.h>
 
 using namespace juce;
 using namespace std;
 
 namespace GUI
 {
-	class VerticalRMSMeter : public Component, public Timer
+	// Meter ballistics, fed with the levels the processor measured block by block. The RMS level jumps up
+	// at once and falls back over releaseSeconds; the peak is held for peakHoldSeconds, then falls
+	class MeterBallistics
 	{
 	public:
 
-		VerticalRMSMeter(function<float()>&& valueFunction) : valueSupplier(move(valueFunction))
+		void addBlock(float sumOfSquares, float peak, int numSamples, double sampleRate)
+		{
+			if (numSamples <= 0) { return; }
+
+			const auto seconds = static_cast<float>(numSamples / sampleRate);
+
+			// Carry on along the current release ramp
+			if (rampRemaining > 0.f)
+			{
+				rmsLevel += (rmsTarget - rmsLevel) * jmin(1.f, seconds / rampRemaining);
+				rampRemaining -= seconds;
+			}
+
+			const auto level = Decibels::gainToDecibels(sqrt(sumOfSquares / static_cast<float>(numSamples)));
+
+			if (level >= rmsLevel)
+			{
+				rmsLevel = rmsTarget = level;
+				rampRemaining = 0.f;
+			}
+			else if (level != rmsTarget)
+			{
+				rmsTarget = level;
+				rampRemaining = releaseSeconds;
+			}
+
+			const auto peakLevel = Decibels::gainToDecibels(peak);
+
+			if (peakLevel >= peakHold)
+			{
+				peakHold = peakLevel;
+				holdRemaining = peakHoldSeconds;
+			}
+			else if ((holdRemaining -= seconds) <= 0.f)
+			{
+				peakHold = jmax(peakLevel, peakHold - peakFallDecibelsPerSecond * seconds);
+			}
+		}
+
+		float getRMSLevel() const	{ return rmsLevel; }
+		float getPeakLevel() const	{ return peakHold; }
+
+	private:
+
+		static constexpr float releaseSeconds = 0.5f, peakHoldSeconds = 1.f, peakFallDecibelsPerSecond = 20.f;
+
+		float rmsLevel{ -100.f }, rmsTarget{ -100.f }, rampRemaining{ 0.f };
+		float peakHold{ -100.f }, holdRemaining{ 0.f };
+	};
+
+	// Level bar with an optional peak line, on a -60 to +6 dB scale. It does not animate itself: the editor
+	// calls update() once per display frame, and only the rows of the bar that changed are repainted
+	class VerticalRMSMeter : public Component
+	{
+	public:
+
+		VerticalRMSMeter(function<float()>&& valueFunction, function<float()>&& peakFunction = {})
+			: valueSupplier(move(valueFunction)), peakSupplier(move(peakFunction))
 		{
-			startTimerHz(24);
 			grill = ImageCache::getFromMemory(BinaryData::MeterGrill_png, BinaryData::MeterGrill_pngSize);
 		}
 
+		// Reads the suppliers and repaints what moved. Level and peak are tracked in whole pixel rows, so a
+		// change of less than a pixel repaints nothing
+		void update()
+		{
+			const auto meterBounds = getMeterBounds();
+
+			const auto newLevelY = getRow(valueSupplier());
+			const auto newPeakY = peakSupplier ? getRow(peakSupplier()) : meterBounds.getBottom();
+
+			if (newLevelY != levelY)
+				repaint(meterBounds.getX(), jmin(levelY, newLevelY), meterBounds.getWidth(), abs(newLevelY - levelY));
+
+			if (newPeakY != peakY)
+			{
+				repaint(meterBounds.getX(), peakY, meterBounds.getWidth(), peakLineHeight);
+				repaint(meterBounds.getX(), newPeakY, meterBounds.getWidth(), peakLineHeight);
+			}
+
+			levelY = newLevelY;
+			peakY = newPeakY;
+		}
+
 		void paint(Graphics& g) override
 		{
-			auto bounds = getLocalBounds().toFloat().reduced(5.f);
+			const auto meterBounds = getMeterBounds();
+
+			// The gradient and the grill are drawn once into images at the display's pixel scale, and copied
+			const auto scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+
+			if (! gradientLayer.isValid() || scale != layerScale)
+				renderLayers(scale);
 
 			g.setColour(Colours::black);
-			g.fillRect(bounds);
+			g.fillRect(meterBounds.withBottom(levelY));
+
+			{
+				Graphics::ScopedSaveState state(g);
+				g.reduceClipRegion(meterBounds.withTop(levelY));
+				g.drawImage(gradientLayer, getLocalBounds().toFloat());
+			}
 
-			g.setGradientFill(gradient);
-			const auto scaledY = jmap(valueSupplier(), -60.f, 6.f, 0.f, static_cast<float>(getHeight()));
-			g.fillRect(bounds.removeFromBottom(scaledY));
+			// Held peak, as a thin line across the bar
+			if (peakY < meterBounds.getBottom())
+			{
+				g.setColour(Colours::white);
+				g.fillRect(meterBounds.getX(), peakY, meterBounds.getWidth(), peakLineHeight);
+			}
+
+			g.drawImage(grillLayer, getLocalBounds().toFloat());
 		}
 
 		void resized() override
 		{
-			const auto bounds = getLocalBounds().toFloat();
-			gradient = ColourGradient{ Colours::greenyellow, bounds.getBottomLeft(), Colours::red, bounds.getTopLeft(), false };
-			gradient.addColour(0.5, Colours::yellow);
+			gradientLayer = {};
+			levelY = peakY = getMeterBounds().getBottom();
 		}
 
-		void paintOverChildren(::juce::Graphics& g) override
+	private:
+
+		static constexpr int peakLineHeight = 2;
+
+		Rectangle<int> getMeterBounds() const	{ return getLocalBounds().reduced(5); }
+
+		// Top row of a bar showing level, or the bottom of the meter when it is below the scale
+		int getRow(float level) const
 		{
-			g.drawImage(grill, getLocalBounds().toFloat());
+			const auto meterBounds = getMeterBounds();
+			const auto height = jmap(level, -60.f, 6.f, 0.f, static_cast<float>(getHeight()));
+
+			if (height <= 0.f) { return meterBounds.getBottom(); }
+
+			return jmax(meterBounds.getY(), roundToInt(static_cast<float>(meterBounds.getBottom()) - height));
 		}
 
-		void timerCallback() override
+		void renderLayers(float scale)
 		{
-			repaint();
-		}
+			layerScale = scale;
 
-	private:
+			const auto width = jmax(1, roundToInt(static_cast<float>(getWidth()) * scale));
+			const auto height = jmax(1, roundToInt(static_cast<float>(getHeight()) * scale));
+			const auto bounds = getLocalBounds().toFloat();
+
+			gradientLayer = Image(Image::ARGB, width, height, true);
+			{
+				Graphics g(gradientLayer);
+				g.addTransform(AffineTransform::scale(scale));
+
+				ColourGradient gradient{ Colours::greenyellow, bounds.getBottomLeft(), Colours::red, bounds.getTopLeft(), false };
+				gradient.addColour(0.5, Colours::yellow);
+
+				g.setGradientFill(gradient);
+				g.fillRect(getMeterBounds());
+			}
+
+			grillLayer = Image(Image::ARGB, width, height, true);
+			{
+				Graphics g(grillLayer);
+				g.addTransform(AffineTransform::scale(scale));
+				g.drawImage(grill, bounds);
+			}
+		}
 
-		function<float()> valueSupplier;
-		ColourGradient gradient{};
-		Image grill;
+		function<float()> valueSupplier, peakSupplier;
+		int levelY{ 0 }, peakY{ 0 };
+		Image grill, gradientLayer, grillLayer;
+		float layerScale{ 1.f };
 	};
-}
\ No newline at end of file
+}
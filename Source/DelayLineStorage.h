@@ -0,0 +1,348 @@
+/*
+  ==============================================================================
+
+    DelayLineStorage.h
+
+    Sample formats for the delay line of PingPongDelayEngine (its Storage
+    template parameter). The ring is by far the largest block of memory the
+    engine streams through, so keeping it in 16 bits halves the traffic of the
+    read and write heads, at the cost of some added noise. Conversions work on
+    whole spans of interleaved samples, with SSE2 or NEON where available.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_dsp/juce_dsp.h>
+
+using namespace juce;
+using namespace std;
+
+namespace DelayStorage
+{
+    //==============================================================================
+    // Samples are kept in the processing precision: no conversion and no added error
+    struct Native
+    {
+        template <typename SampleType> using Type = SampleType;
+
+        static constexpr const char* name = "float";
+
+        template <typename SampleType>
+        static void encode(const SampleType* source, SampleType* destination, int numSamples, uint32*)
+        {
+            memcpy(destination, source, sizeof(SampleType) * (size_t) numSamples);
+        }
+
+        template <typename SampleType>
+        static void decode(const SampleType* source, SampleType* destination, int numSamples)
+        {
+            memcpy(destination, source, sizeof(SampleType) * (size_t) numSamples);
+        }
+    };
+
+    //==============================================================================
+    // IEEE 754 half precision: 11 significant bits, so the error stays around 66 dB below the signal
+    // at any level. Values beyond +-65504 are saturated rather than turned into infinities
+    struct Half
+    {
+        template <typename SampleType> using Type = uint16;
+
+        static constexpr const char* name = "fp16";
+
+        template <typename SampleType>
+        static void encode(const SampleType* source, uint16* destination, int numSamples, uint32*)
+        {
+            int sample = 0;
+
+            if constexpr (is_same_v<SampleType, float>)
+            {
+               #if JUCE_USE_SIMD && (defined (__SSE2__) || defined (_M_X64) || defined (_M_AMD64))
+                for (; sample + 4 <= numSamples; sample += 4)
+                    _mm_storel_epi64((__m128i*) (destination + sample), encodeSSE2(_mm_loadu_ps(source + sample)));
+               #elif JUCE_USE_SIMD && (defined (__aarch64__) || defined (_M_ARM64))
+                const auto limit = vdupq_n_f32(65504.0f);
+
+                for (; sample + 4 <= numSamples; sample += 4)
+                {
+                    const auto clamped = vmaxq_f32(vnegq_f32(limit), vminq_f32(limit, vld1q_f32(source + sample)));
+                    vst1_u16(destination + sample, vreinterpret_u16_f16(vcvt_f16_f32(clamped)));
+                }
+               #endif
+            }
+
+            for (; sample < numSamples; ++sample)
+                destination[sample] = fromFloat((float) source[sample]);
+        }
+
+        template <typename SampleType>
+        static void decode(const uint16* source, SampleType* destination, int numSamples)
+        {
+            int sample = 0;
+
+            if constexpr (is_same_v<SampleType, float>)
+            {
+               #if JUCE_USE_SIMD && (defined (__SSE2__) || defined (_M_X64) || defined (_M_AMD64))
+                for (; sample + 4 <= numSamples; sample += 4)
+                    _mm_storeu_ps(destination + sample, decodeSSE2(_mm_loadl_epi64((const __m128i*) (source + sample))));
+               #elif JUCE_USE_SIMD && (defined (__aarch64__) || defined (_M_ARM64))
+                for (; sample + 4 <= numSamples; sample += 4)
+                    vst1q_f32(destination + sample, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(source + sample))));
+               #endif
+            }
+
+            for (; sample < numSamples; ++sample)
+                destination[sample] = (SampleType) toFloat(source[sample]);
+        }
+
+        // Round to nearest even. Small values become half precision denormals, so a decaying tail still
+        // reaches zero smoothly
+        static uint16 fromFloat(float value)
+        {
+            uint32 bits;
+            memcpy(&bits, &value, sizeof(bits));
+
+            const uint32 sign = bits & 0x80000000u;
+            bits ^= sign;
+
+            uint32 result;
+
+            if (bits > 0x477fe000u)                 // Beyond 65504 (or not a number): saturate
+            {
+                result = 0x7bffu;
+            }
+            else if (bits < (113u << 23))           // Below the smallest normal half: denormal or zero
+            {
+                const uint32 magicBits = ((127 - 15) + (23 - 10) + 1) << 23;
+                float magic, shifted;
+                memcpy(&magic, &magicBits, sizeof(magic));
+                memcpy(&shifted, &bits, sizeof(shifted));
+
+                shifted += magic;
+                memcpy(&result, &shifted, sizeof(result));
+                result -= magicBits;
+            }
+            else
+            {
+                const uint32 mantissaOdd = (bits >> 13) & 1;
+                bits += ((uint32) (15 - 127) << 23) + 0xfff + mantissaOdd;
+                result = bits >> 13;
+            }
+
+            return (uint16) (result | (sign >> 16));
+        }
+
+        static float toFloat(uint16 value)
+        {
+            const uint32 magicBits = 113u << 23;
+            uint32 bits = (uint32) (value & 0x7fff) << 13;
+            const uint32 exponent = bits & (0x7c00u << 13);
+
+            bits += (127 - 15) << 23;
+
+            if (exponent == (0x7c00u << 13))        // Infinity or not a number
+            {
+                bits += (128 - 16) << 23;
+            }
+            else if (exponent == 0)                 // Denormal: let the FPU normalise it
+            {
+                bits += 1 << 23;
+
+                float result, magic;
+                memcpy(&result, &bits, sizeof(result));
+                memcpy(&magic, &magicBits, sizeof(magic));
+                result -= magic;
+                memcpy(&bits, &result, sizeof(bits));
+            }
+
+            bits |= (uint32) (value & 0x8000) << 16;
+
+            float result;
+            memcpy(&result, &bits, sizeof(result));
+            return result;
+        }
+
+    private:
+       #if JUCE_USE_SIMD && (defined (__SSE2__) || defined (_M_X64) || defined (_M_AMD64))
+        // fromFloat() on four lanes: both branches are computed and the right one picked per lane.
+        // Returns the four halves in the low 64 bits
+        static __m128i encodeSSE2(__m128 value)
+        {
+            const __m128i magicBits = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+            const __m128 signMask   = _mm_castsi128_ps(_mm_set1_epi32((int) 0x80000000u));
+
+            const __m128 sign       = _mm_and_ps(value, signMask);
+            const __m128 magnitude  = _mm_min_ps(_mm_xor_ps(value, sign), _mm_set1_ps(65504.0f));
+            const __m128i bits      = _mm_castps_si128(magnitude);
+
+            const __m128i mantissaOdd   = _mm_and_si128(_mm_srli_epi32(bits, 13), _mm_set1_epi32(1));
+            const __m128i normal        = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(bits, _mm_set1_epi32((int) (((uint32) (15 - 127) << 23) + 0xfff))), mantissaOdd), 13);
+            const __m128i denormal      = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(magnitude, _mm_castsi128_ps(magicBits))), magicBits);
+
+            const __m128i isDenormal    = _mm_cmplt_epi32(bits, _mm_set1_epi32(113 << 23));
+            __m128i result              = _mm_or_si128(_mm_and_si128(isDenormal, denormal), _mm_andnot_si128(isDenormal, normal));
+
+            result = _mm_or_si128(result, _mm_srli_epi32(_mm_castps_si128(sign), 16));
+
+            // Sign-extend from 16 bits so the saturating pack leaves every bit pattern as it is
+            result = _mm_srai_epi32(_mm_slli_epi32(result, 16), 16);
+            return _mm_packs_epi32(result, result);
+        }
+
+        // toFloat() on the four halves in the low 64 bits. The exponent is rebiased with integer arithmetic
+        // and denormals are converted from their integer mantissa, so no lane ever holds a float denormal
+        // and the result is the same with denormals flushed to zero (ScopedNoDenormals)
+        static __m128 decodeSSE2(__m128i value)
+        {
+            const __m128i halves    = _mm_unpacklo_epi16(value, _mm_setzero_si128());
+            const __m128i magnitude = _mm_and_si128(halves, _mm_set1_epi32(0x7fff));
+            const __m128i sign      = _mm_slli_epi32(_mm_xor_si128(halves, magnitude), 16);
+
+            const __m128i isInfNaN      = _mm_cmpgt_epi32(magnitude, _mm_set1_epi32(0x7bff));
+            const __m128i isDenormal    = _mm_cmplt_epi32(magnitude, _mm_set1_epi32(0x0400));
+
+            __m128i normal = _mm_add_epi32(_mm_slli_epi32(magnitude, 13), _mm_set1_epi32((127 - 15) << 23));
+            normal = _mm_add_epi32(normal, _mm_and_si128(isInfNaN, _mm_set1_epi32((128 - 16) << 23)));
+
+            // A denormal half is its mantissa times 2^-24, which is a normal float
+            const __m128i denormal  = _mm_castps_si128(_mm_mul_ps(_mm_cvtepi32_ps(magnitude), _mm_set1_ps(1.0f / 16777216.0f)));
+            const __m128i result    = _mm_or_si128(_mm_and_si128(isDenormal, denormal), _mm_andnot_si128(isDenormal, normal));
+
+            return _mm_castsi128_ps(_mm_or_si128(result, sign));
+        }
+       #endif
+    };
+
+    //==============================================================================
+    // 16-bit fixed point with 12 dB of headroom above full scale (the feedback can build the ring up
+    // past it; beyond that it saturates), rounded with TPDF dither. The dither is left out for samples
+    // under half a step, so silence is stored as zeros and the engine can still go to sleep
+    struct Int16
+    {
+        template <typename SampleType> using Type = int16;
+
+        static constexpr const char* name = "int16";
+
+        static constexpr float headroom     = 4.0f;
+        static constexpr float encodeScale  = 32767.0f / headroom;
+        static constexpr float decodeScale  = headroom / 32767.0f;
+
+        template <typename SampleType>
+        static void encode(const SampleType* source, int16* destination, int numSamples, uint32* ditherState)
+        {
+            int sample = 0;
+
+            if constexpr (is_same_v<SampleType, float>)
+            {
+               #if JUCE_USE_SIMD && (defined (__SSE2__) || defined (_M_X64) || defined (_M_AMD64))
+                auto state = _mm_loadu_si128((const __m128i*) ditherState);
+
+                for (; sample + 8 <= numSamples; sample += 8)
+                {
+                    const auto low  = _mm_cvtps_epi32(ditherSSE2(_mm_mul_ps(_mm_loadu_ps(source + sample),     _mm_set1_ps(encodeScale)), state));
+                    const auto high = _mm_cvtps_epi32(ditherSSE2(_mm_mul_ps(_mm_loadu_ps(source + sample + 4), _mm_set1_ps(encodeScale)), state));
+
+                    _mm_storeu_si128((__m128i*) (destination + sample), _mm_packs_epi32(low, high));
+                }
+
+                _mm_storeu_si128((__m128i*) ditherState, state);
+               #elif JUCE_USE_SIMD && (defined (__aarch64__) || defined (_M_ARM64))
+                auto state = vld1q_u32(ditherState);
+
+                for (; sample + 8 <= numSamples; sample += 8)
+                {
+                    const auto low  = vcvtnq_s32_f32(ditherNEON(vmulq_n_f32(vld1q_f32(source + sample),     encodeScale), state));
+                    const auto high = vcvtnq_s32_f32(ditherNEON(vmulq_n_f32(vld1q_f32(source + sample + 4), encodeScale), state));
+
+                    vst1q_s16(destination + sample, vcombine_s16(vqmovn_s32(low), vqmovn_s32(high)));
+                }
+
+                vst1q_u32(ditherState, state);
+               #endif
+            }
+
+            for (; sample < numSamples; ++sample)
+            {
+                const float scaled = (float) source[sample] * encodeScale;
+                float dither = 0.0f;
+
+                if (abs(scaled) >= 0.5f)
+                {
+                    uint32& state = ditherState[sample & 3];
+                    state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+
+                    dither = (float) ((int) (state & 0xffff) - (int) (state >> 16)) * (1.0f / 65536.0f);
+                }
+
+                destination[sample] = (int16) jlimit(-32768.0f, 32767.0f, nearbyint(scaled + dither));
+            }
+        }
+
+        template <typename SampleType>
+        static void decode(const int16* source, SampleType* destination, int numSamples)
+        {
+            int sample = 0;
+
+            if constexpr (is_same_v<SampleType, float>)
+            {
+               #if JUCE_USE_SIMD && (defined (__SSE2__) || defined (_M_X64) || defined (_M_AMD64))
+                for (; sample + 8 <= numSamples; sample += 8)
+                {
+                    const auto values = _mm_loadu_si128((const __m128i*) (source + sample));
+
+                    // Sign-extend to 32 bits by unpacking each value into the top half of a lane
+                    const auto low  = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(values, values), 16));
+                    const auto high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(values, values), 16));
+
+                    _mm_storeu_ps(destination + sample,     _mm_mul_ps(low,  _mm_set1_ps(decodeScale)));
+                    _mm_storeu_ps(destination + sample + 4, _mm_mul_ps(high, _mm_set1_ps(decodeScale)));
+                }
+               #elif JUCE_USE_SIMD && (defined (__aarch64__) || defined (_M_ARM64))
+                for (; sample + 8 <= numSamples; sample += 8)
+                {
+                    const auto values = vld1q_s16(source + sample);
+
+                    vst1q_f32(destination + sample,     vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(values))),  decodeScale));
+                    vst1q_f32(destination + sample + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(values))), decodeScale));
+                }
+               #endif
+            }
+
+            for (; sample < numSamples; ++sample)
+                destination[sample] = (SampleType) ((float) source[sample] * decodeScale);
+        }
+
+    private:
+        // Adds TPDF dither of +-1 step to four scaled samples, from four xorshift32 generators
+       #if JUCE_USE_SIMD && (defined (__SSE2__) || defined (_M_X64) || defined (_M_AMD64))
+        static __m128 ditherSSE2(__m128 scaled, __m128i& state)
+        {
+            state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+            state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+            state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+
+            const auto difference   = _mm_sub_epi32(_mm_and_si128(state, _mm_set1_epi32(0xffff)), _mm_srli_epi32(state, 16));
+            const auto dither       = _mm_mul_ps(_mm_cvtepi32_ps(difference), _mm_set1_ps(1.0f / 65536.0f));
+
+            const auto magnitude    = _mm_andnot_ps(_mm_set1_ps(-0.0f), scaled);
+            const auto isAudible    = _mm_cmpge_ps(magnitude, _mm_set1_ps(0.5f));
+
+            return _mm_add_ps(scaled, _mm_and_ps(isAudible, dither));
+        }
+       #elif JUCE_USE_SIMD && (defined (__aarch64__) || defined (_M_ARM64))
+        static float32x4_t ditherNEON(float32x4_t scaled, uint32x4_t& state)
+        {
+            state = veorq_u32(state, vshlq_n_u32(state, 13));
+            state = veorq_u32(state, vshrq_n_u32(state, 17));
+            state = veorq_u32(state, vshlq_n_u32(state, 5));
+
+            const auto difference   = vsubq_s32(vreinterpretq_s32_u32(vandq_u32(state, vdupq_n_u32(0xffff))), vreinterpretq_s32_u32(vshrq_n_u32(state, 16)));
+            const auto dither       = vmulq_n_f32(vcvtq_f32_s32(difference), 1.0f / 65536.0f);
+            const auto isAudible    = vcgeq_f32(vabsq_f32(scaled), vdupq_n_f32(0.5f));
+
+            return vaddq_f32(scaled, vreinterpretq_f32_u32(vandq_u32(isAudible, vreinterpretq_u32_f32(dither))));
+        }
+       #endif
+    };
+}
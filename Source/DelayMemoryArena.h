@@ -0,0 +1,286 @@
+/*
+  ==============================================================================
+
+    DelayMemoryArena.h
+
+    Process-wide pool for the engines' delay lines. Rather than each instance
+    allocating its own multi-megabyte ring from the heap, rings are carved out
+    of a few large slabs, and regions freed by instances that are removed or
+    re-prepared are reused. Loading a large session then makes a handful of
+    big allocations, and a long-running host does not fragment its heap.
+
+    Allocating and freeing take a lock and may allocate, so they belong in
+    prepare() and background threads, never the audio thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <list>
+#include <map>
+#include <utility>
+
+using namespace juce;
+using namespace std;
+
+//==============================================================================
+class DelayMemoryArena
+{
+public:
+    // Every region starts on a page boundary, so also on a cache line
+   #if JUCE_MAC && JUCE_ARM
+    static constexpr size_t regionAlignment = 16384;
+   #else
+    static constexpr size_t regionAlignment = 4096;
+   #endif
+
+    // A new slab holds this many regions of the size that needed it, rounded up to a power of two, or as
+    // much as the slabs already held, whichever is bigger: a session that keeps growing needs only a few
+    // slabs, and a single small instance does not reserve much more than it uses
+    static constexpr size_t regionsPerSlab = 4;
+
+    struct Footprint
+    {
+        size_t  reservedBytes{0};   // Held in slabs
+        size_t  usedBytes{0};       // Handed out in regions
+        int     numSlabs{0}, numRegions{0};
+    };
+
+    ~DelayMemoryArena()
+    {
+        jassert(regions.empty());   // A delay line has outlived the arena
+
+        for (auto& slab : slabs)
+            ::operator delete(slab.memory, align_val_t(regionAlignment));
+    }
+
+    static DelayMemoryArena& getInstance()
+    {
+        static DelayMemoryArena arena;
+        return arena;
+    }
+
+    // Returns a region of at least numBytes, uninitialised
+    void* allocate(size_t numBytes)
+    {
+        const size_t size = jmax(regionAlignment, (numBytes + regionAlignment - 1) & ~(regionAlignment - 1));
+
+        const ScopedLock sl(lock);
+
+        // Best fit over every slab's free blocks, so small rings fill the gaps left between big ones
+        Slab* bestSlab = nullptr;
+        map<size_t, size_t>::iterator bestBlock;
+
+        for (auto& slab : slabs)
+        {
+            for (auto block = slab.freeBlocks.begin(); block != slab.freeBlocks.end(); ++block)
+            {
+                if (block->second >= size && (bestSlab == nullptr || block->second < bestBlock->second))
+                {
+                    bestSlab    = &slab;
+                    bestBlock   = block;
+                }
+            }
+        }
+
+        if (bestSlab == nullptr)
+        {
+            Slab slab;
+            slab.size   = jmax(getSlabSize(size), getReservedBytes());
+            slab.memory = static_cast<char*>(::operator new(slab.size, align_val_t(regionAlignment)));
+            slab.freeBlocks[0] = slab.size;
+
+            slabs.push_back(move(slab));
+            bestSlab    = &slabs.back();
+            bestBlock   = bestSlab->freeBlocks.begin();
+        }
+
+        const size_t offset     = bestBlock->first;
+        const size_t blockSize  = bestBlock->second;
+
+        bestSlab->freeBlocks.erase(bestBlock);
+
+        if (blockSize > size)
+            bestSlab->freeBlocks[offset + size] = blockSize - size;
+
+        bestSlab->usedBytes += size;
+
+        void* region = bestSlab->memory + offset;
+        regions[region] = size;
+        return region;
+    }
+
+    // Returns a region to its slab. One empty slab is kept for reuse while any region is still handed out;
+    // once the last one comes back, every slab is freed
+    void release(void* region)
+    {
+        if (region == nullptr) { return; }
+
+        const ScopedLock sl(lock);
+
+        const auto found = regions.find(region);
+
+        if (found == regions.end())
+        {
+            jassertfalse;   // Not allocated by this arena, or released twice
+            return;
+        }
+
+        auto slab = find_if(slabs.begin(), slabs.end(), [region] (const Slab& s)
+        {
+            return static_cast<char*>(region) >= s.memory && static_cast<char*>(region) < s.memory + s.size;
+        });
+
+        if (slab == slabs.end())
+        {
+            jassertfalse;   // The region's slab has gone
+            return;
+        }
+
+        const size_t size = found->second;
+        regions.erase(found);
+
+        size_t offset       = (size_t) (static_cast<char*>(region) - slab->memory);
+        size_t blockSize    = size;
+
+        // Merge with the free blocks on either side
+        auto next = slab->freeBlocks.lower_bound(offset);
+
+        if (next != slab->freeBlocks.end() && next->first == offset + blockSize)
+        {
+            blockSize += next->second;
+            next = slab->freeBlocks.erase(next);
+        }
+
+        if (next != slab->freeBlocks.begin())
+        {
+            auto previous = prev(next);
+
+            if (previous->first + previous->second == offset)
+            {
+                offset = previous->first;
+                blockSize += previous->second;
+                slab->freeBlocks.erase(previous);
+            }
+        }
+
+        slab->freeBlocks[offset] = blockSize;
+        slab->usedBytes -= size;
+
+        if (regions.empty())
+        {
+            for (auto& emptySlab : slabs)
+                ::operator delete(emptySlab.memory, align_val_t(regionAlignment));
+
+            slabs.clear();
+        }
+        else if (slab->usedBytes == 0)
+        {
+            const bool hasOtherEmptySlab = any_of(slabs.begin(), slabs.end(), [&] (const Slab& s)
+            {
+                return &s != &*slab && s.usedBytes == 0;
+            });
+
+            if (hasOtherEmptySlab)
+            {
+                ::operator delete(slab->memory, align_val_t(regionAlignment));
+                slabs.erase(slab);
+            }
+        }
+    }
+
+    Footprint getFootprint() const
+    {
+        const ScopedLock sl(lock);
+
+        Footprint footprint;
+        footprint.numSlabs      = (int) slabs.size();
+        footprint.numRegions    = (int) regions.size();
+
+        for (auto& slab : slabs)
+        {
+            footprint.reservedBytes += slab.size;
+            footprint.usedBytes     += slab.usedBytes;
+        }
+
+        return footprint;
+    }
+
+private:
+    DelayMemoryArena() = default;
+
+    static size_t getSlabSize(size_t regionSize)
+    {
+        size_t slabSize = regionAlignment;
+
+        while (slabSize < regionsPerSlab * regionSize)
+            slabSize <<= 1;
+
+        return slabSize;
+    }
+
+    size_t getReservedBytes() const
+    {
+        size_t reservedBytes = 0;
+
+        for (auto& slab : slabs)
+            reservedBytes += slab.size;
+
+        return reservedBytes;
+    }
+
+    struct Slab
+    {
+        char*               memory{nullptr};
+        size_t              size{0}, usedBytes{0};
+        map<size_t, size_t> freeBlocks;         // Offset -> size of each free block, merged with its neighbours
+    };
+
+    list<Slab>              slabs;              // A list, so a slab stays put while others come and go
+    map<void*, size_t>      regions;            // Size of each region handed out
+    CriticalSection         lock;
+
+    JUCE_DECLARE_NON_COPYABLE (DelayMemoryArena)
+};
+
+//==============================================================================
+/**
+    Owns one region of the DelayMemoryArena, like a HeapBlock. Moving or swapping
+    it never touches the arena, so the audio thread can swap rings freely.
+*/
+template <typename ElementType>
+class DelayMemoryBlock
+{
+public:
+    DelayMemoryBlock() = default;
+    ~DelayMemoryBlock()                                         { free(); }
+
+    DelayMemoryBlock(DelayMemoryBlock&& other) noexcept         : data(exchange(other.data, nullptr)) {}
+    DelayMemoryBlock& operator=(DelayMemoryBlock&& other) noexcept { swapWith(other); return *this; }
+
+    // Frees the current region and takes a new, uninitialised one of numElements elements
+    void allocate(size_t numElements)
+    {
+        free();
+        data = static_cast<ElementType*>(DelayMemoryArena::getInstance().allocate(numElements * sizeof(ElementType)));
+    }
+
+    void free()
+    {
+        DelayMemoryArena::getInstance().release(exchange(data, nullptr));
+    }
+
+    ElementType* get() const noexcept                           { return data; }
+    operator ElementType*() const noexcept                      { return data; }
+    template <typename IndexType>
+    ElementType& operator[](IndexType index) const noexcept     { return data[index]; }
+
+    void swapWith(DelayMemoryBlock& other) noexcept             { std::swap(data, other.data); }
+
+private:
+    ElementType* data{nullptr};
+
+    JUCE_DECLARE_NON_COPYABLE (DelayMemoryBlock)
+};
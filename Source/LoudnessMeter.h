@@ -0,0 +1,412 @@
+/*
+  ==============================================================================
+
+    LoudnessMeter.h
+
+    ITU-R BS.1770 loudness of a stereo signal: momentary (400 ms), short-term
+    (3 s) and gated integrated loudness in LUFS, plus the true peak. The
+    K-weighted energy is collected in 100 ms blocks held in a ring, and each
+    window's sum is updated as blocks enter and leave it rather than summed
+    again. Like the engine it only needs juce_dsp, and process() never
+    allocates.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_dsp/juce_dsp.h>
+
+using namespace juce;
+using namespace std;
+
+//==============================================================================
+class LoudnessMeter
+{
+public:
+    static constexpr int numChannels = 2;
+
+    // Loudness reported while a window holds nothing above the absolute gate
+    static constexpr float silence = -100.0f;
+
+    LoudnessMeter()
+    {
+        // Polyphase 4x interpolator for the true peak. Tap t multiplies the sample t samples back, so phase p
+        // estimates the signal p/4 of a sample before the one at tap (interpolationTaps / 2 - 1), between it
+        // and the next tap. A Blackman-windowed sinc rather than the example filter of BS.1770 Annex 2,
+        // which the Recommendation leaves open
+        for (int phase = 0; phase < maxOversampling; ++phase)
+        {
+            double sum = 0.0;
+
+            for (int tap = 0; tap < interpolationTaps; ++tap)
+            {
+                const double distance   = (double) tap - (double) (interpolationTaps / 2 - 1) - (double) phase / (double) maxOversampling;
+                const double x          = MathConstants<double>::pi * distance;
+                const double sinc       = distance == 0.0 ? 1.0 : sin(x) / x;
+                const double position   = (distance + (double) interpolationTaps / 2.0) / (double) interpolationTaps;
+                const double window     = 0.42 - 0.5 * cos(MathConstants<double>::twoPi * position) + 0.08 * cos(2.0 * MathConstants<double>::twoPi * position);
+
+                interpolator[phase][tap] = (float) (sinc * window);
+                sum += sinc * window;
+            }
+
+            for (auto& coefficient : interpolator[phase])
+                coefficient = (float) (coefficient / sum);
+        }
+    }
+
+    //==============================================================================
+    void prepare(double sampleRate)
+    {
+        blockLength = jmax(1, roundToInt(sampleRate * 0.1));
+
+        // Oversample the true peak up to at least 192 kHz
+        oversampling = sampleRate < 96000.0 ? 4 : (sampleRate < 192000.0 ? 2 : 1);
+
+        // K-weighting: a high shelf for the head, then the RLB high pass, for any sample rate
+        {
+            const double k  = tan(MathConstants<double>::pi * 1681.974450955533 / sampleRate);
+            const double q  = 0.7071752369554196;
+            const double vh = pow(10.0, 3.999843853973347 / 20.0);
+            const double vb = pow(vh, 0.4996667741545416);
+            const double a0 = 1.0 + k / q + k * k;
+
+            shelf = { (vh + vb * k / q + k * k) / a0, 2.0 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0,
+                      2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0 };
+        }
+
+        {
+            const double k  = tan(MathConstants<double>::pi * 38.13547087602444 / sampleRate);
+            const double q  = 0.5003270373238773;
+            const double a0 = 1.0 + k / q + k * k;
+
+            highPass = { 1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0 };
+        }
+
+        reset();
+    }
+
+    // Clears the windows, the integrated loudness and the filters
+    void reset()
+    {
+        zeromem(filterState, sizeof(filterState));
+        zeromem(history, sizeof(history));
+        zeromem(blockEnergies, sizeof(blockEnergies));
+        zeromem(histogramCounts, sizeof(histogramCounts));
+        zeromem(histogramEnergies, sizeof(histogramEnergies));
+
+        blockPosition = numBlocks = ringPosition = 0;
+        momentarySum = shortTermSum = 0.0;
+
+        for (auto& sum : blockSums) { sum = 0.0; }
+        for (auto& peak : truePeaks) { peak = 0.0f; }
+
+        momentaryLoudness = shortTermLoudness = integratedLoudness = silence;
+    }
+
+    //==============================================================================
+    // Measures numSamples samples of both channels
+    template <typename SampleType>
+    void process(const SampleType* const* channels, int numSamples)
+    {
+        for (auto& peak : truePeaks) { peak = 0.0f; }
+
+        for (int position = 0; position < numSamples; position += chunkSize)
+        {
+            const int numChunkSamples = jmin(chunkSize, numSamples - position);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                // The interpolator reads interpolationTaps - 1 samples back, so each chunk follows on from
+                // the end of the last one
+                alignas(16) float signal[historyLength + chunkSize];
+
+                memcpy(signal, history[channel], sizeof(history[channel]));
+
+                for (int sample = 0; sample < numChunkSamples; ++sample)
+                    signal[historyLength + sample] = (float) channels[channel][position + sample];
+
+                const float peak = oversampling == 4 ? measureTruePeak<3>(signal, numChunkSamples)
+                                 : (oversampling == 2 ? measureTruePeak<1>(signal, numChunkSamples)
+                                                      : measureTruePeak<0>(signal, numChunkSamples));
+
+                truePeaks[channel] = jmax(truePeaks[channel], peak);
+                memcpy(history[channel], signal + numChunkSamples, sizeof(history[channel]));
+            }
+
+            // The blocks may end inside the chunk
+            for (int sample = 0; sample < numChunkSamples;)
+            {
+                const int numBlockSamples = jmin(numChunkSamples - sample, blockLength - blockPosition);
+
+                kWeight(channels, position + sample, numBlockSamples);
+                sample += numBlockSamples;
+
+                if ((blockPosition += numBlockSamples) >= blockLength)
+                    finishBlock();
+            }
+        }
+    }
+
+    // Equivalent to process() on numSamples of digital silence, for when the signal is known to be silent:
+    // it only moves the windows on, leaving the filters at rest
+    void addSilence(int numSamples)
+    {
+        for (auto& peak : truePeaks) { peak = 0.0f; }
+
+        zeromem(filterState, sizeof(filterState));
+        zeromem(history, sizeof(history));
+
+        while (numSamples > 0)
+        {
+            const int numBlockSamples = jmin(numSamples, blockLength - blockPosition);
+            numSamples -= numBlockSamples;
+
+            if ((blockPosition += numBlockSamples) >= blockLength)
+                finishBlock();
+        }
+    }
+
+    // In LUFS, as of the last 100 ms block, or silence
+    float getMomentaryLoudness() const      { return momentaryLoudness; }
+    float getShortTermLoudness() const      { return shortTermLoudness; }
+    float getIntegratedLoudness() const     { return integratedLoudness; }
+
+    // Largest interpolated absolute sample value of a channel over the last call to process()
+    float getTruePeak(int channel) const
+    {
+        jassert(isPositiveAndBelow(channel, numChannels));
+        return truePeaks[channel];
+    }
+
+private:
+    //==============================================================================
+    using Vector = dsp::SIMDRegister<float>;
+
+    static constexpr int        chunkSize           = 256;
+    static constexpr int        maxOversampling     = 4;
+    static constexpr int        interpolationTaps   = 12;
+    static constexpr int        historyLength       = interpolationTaps - 1;
+
+    static constexpr int        momentaryBlocks     = 4;            // 400 ms
+    static constexpr int        shortTermBlocks     = 30;           // 3 s
+
+    // Gating of the integrated loudness: 400 ms windows below the absolute gate are ignored, and then
+    // those more than relativeGate below the loudness of the rest. The windows are counted in a
+    // histogram of 0.1 LU bins (their number and summed energy) rather than kept
+    static constexpr float      absoluteGate        = -70.0f;
+    static constexpr float      relativeGate        = -10.0f;
+    static constexpr float      histogramResolution = 0.1f;
+    static constexpr int        numHistogramBins    = 800;          // Up to +10 LUFS
+
+    struct Biquad
+    {
+        double  b0{1}, b1{0}, b2{0}, a1{0}, a2{0};
+    };
+
+    Biquad                      shelf, highPass;
+    double                      filterState[numChannels][4] {};    // Transposed direct form II: shelf s1, s2, high pass s1, s2
+
+    float                       interpolator[maxOversampling][interpolationTaps] {};
+    float                       history[numChannels][historyLength] {};
+    int                         oversampling{4};
+    float                       truePeaks[numChannels] {};
+
+    int                         blockLength{4800}, blockPosition{0};
+    double                      blockSums[numChannels] {};          // K-weighted sum of squares of the current block
+
+    // Mean square of the last shortTermBlocks blocks, newest at ringPosition - 1, and the running sums of
+    // the newest momentaryBlocks and shortTermBlocks of them
+    double                      blockEnergies[shortTermBlocks] {};
+    int                         ringPosition{0}, numBlocks{0};
+    double                      momentarySum{0}, shortTermSum{0};
+
+    uint32                      histogramCounts[numHistogramBins] {};
+    double                      histogramEnergies[numHistogramBins] {};
+
+    float                       momentaryLoudness{silence}, shortTermLoudness{silence}, integratedLoudness{silence};
+
+    //==============================================================================
+    static float energyToLoudness(double energy)
+    {
+        return energy > 0.0 ? jmax(silence, (float) (-0.691 + 10.0 * log10(energy))) : silence;
+    }
+
+    // Adds numSamples K-weighted samples of each channel, from offset on, to the block sums. Both channels go
+    // through the same loop, so that their filters' dependency chains overlap
+    template <typename SampleType>
+    void kWeight(const SampleType* const* channels, int offset, int numSamples)
+    {
+        static_assert(numChannels == 2, "kWeight() filters a stereo pair");
+
+        const SampleType* left  = channels[0] + offset;
+        const SampleType* right = channels[1] + offset;
+
+        double l0 = filterState[0][0], l1 = filterState[0][1], l2 = filterState[0][2], l3 = filterState[0][3];
+        double r0 = filterState[1][0], r1 = filterState[1][1], r2 = filterState[1][2], r3 = filterState[1][3];
+        double leftSum = 0.0, rightSum = 0.0;
+
+        for (int sample = 0; sample < numSamples; ++sample)
+        {
+            const double leftInput      = (double) left[sample];
+            const double rightInput     = (double) right[sample];
+
+            const double leftShelved    = shelf.b0 * leftInput + l0;
+            const double rightShelved   = shelf.b0 * rightInput + r0;
+
+            l0 = shelf.b1 * leftInput - shelf.a1 * leftShelved + l1;
+            r0 = shelf.b1 * rightInput - shelf.a1 * rightShelved + r1;
+            l1 = shelf.b2 * leftInput - shelf.a2 * leftShelved;
+            r1 = shelf.b2 * rightInput - shelf.a2 * rightShelved;
+
+            const double leftOutput     = highPass.b0 * leftShelved + l2;
+            const double rightOutput    = highPass.b0 * rightShelved + r2;
+
+            l2 = highPass.b1 * leftShelved - highPass.a1 * leftOutput + l3;
+            r2 = highPass.b1 * rightShelved - highPass.a1 * rightOutput + r3;
+            l3 = highPass.b2 * leftShelved - highPass.a2 * leftOutput;
+            r3 = highPass.b2 * rightShelved - highPass.a2 * rightOutput;
+
+            leftSum     += leftOutput * leftOutput;
+            rightSum    += rightOutput * rightOutput;
+        }
+
+        filterState[0][0] = l0; filterState[0][1] = l1; filterState[0][2] = l2; filterState[0][3] = l3;
+        filterState[1][0] = r0; filterState[1][1] = r1; filterState[1][2] = r2; filterState[1][3] = r3;
+
+        blockSums[0] += leftSum;
+        blockSums[1] += rightSum;
+    }
+
+    // Peak of signal[historyLength ...] and of NumPhases points interpolated evenly between each of its
+    // samples, four outputs a register at a time: each tap multiplies four consecutive input samples, and
+    // every phase works from the same loads
+    template <int NumPhases>
+    float measureTruePeak(const float* signal, int numSamples) const
+    {
+        constexpr int phaseStep = maxOversampling / (NumPhases + 1);
+
+        const float* const input = signal + historyLength;
+        const int numVectorSamples = numSamples - (numSamples % (int) Vector::size());
+
+        auto peaks = Vector::expand(0.0f);
+
+        for (int sample = 0; sample < numVectorSamples; sample += (int) Vector::size())
+        {
+            Vector sums[NumPhases + 1];
+
+            memcpy(&sums[0], input + sample, sizeof(Vector));
+
+            for (int phase = 1; phase <= NumPhases; ++phase)
+                sums[phase] = Vector::expand(0.0f);
+
+            for (int tap = 0; tap < interpolationTaps && NumPhases > 0; ++tap)
+            {
+                Vector samples;
+                memcpy(&samples, input + sample - tap, sizeof(Vector));
+
+                for (int phase = 1; phase <= NumPhases; ++phase)
+                    sums[phase] += samples * interpolator[phase * phaseStep][tap];
+            }
+
+            for (auto& sum : sums)
+                peaks = Vector::max(peaks, Vector::abs(sum));
+        }
+
+        float peak = 0.0f;
+
+        for (size_t lane = 0; lane < Vector::size(); ++lane)
+            peak = jmax(peak, peaks.get(lane));
+
+        for (int sample = numVectorSamples; sample < numSamples; ++sample)
+        {
+            peak = jmax(peak, abs(input[sample]));
+
+            for (int phase = 1; phase <= NumPhases; ++phase)
+            {
+                float sum = 0.0f;
+
+                for (int tap = 0; tap < interpolationTaps; ++tap)
+                    sum += input[sample - tap] * interpolator[phase * phaseStep][tap];
+
+                peak = jmax(peak, abs(sum));
+            }
+        }
+
+        return peak;
+    }
+
+    // Moves the windows on by the 100 ms block just completed
+    void finishBlock()
+    {
+        double energy = 0.0;
+
+        for (auto& sum : blockSums)
+        {
+            energy += sum / (double) blockLength;
+            sum = 0.0;
+        }
+
+        blockPosition = 0;
+
+        const int leavingMomentary = (ringPosition - momentaryBlocks + shortTermBlocks) % shortTermBlocks;
+
+        momentarySum += energy - blockEnergies[leavingMomentary];
+        shortTermSum += energy - blockEnergies[ringPosition];
+        blockEnergies[ringPosition] = energy;
+
+        // Summing the ring again each time round keeps rounding errors from piling up in the running sums
+        if ((ringPosition = (ringPosition + 1) % shortTermBlocks) == 0)
+        {
+            momentarySum = shortTermSum = 0.0;
+
+            for (int block = 0; block < shortTermBlocks; ++block)
+            {
+                shortTermSum += blockEnergies[block];
+
+                if (block >= shortTermBlocks - momentaryBlocks)
+                    momentarySum += blockEnergies[block];
+            }
+        }
+
+        numBlocks = jmin(numBlocks + 1, shortTermBlocks);
+
+        momentaryLoudness = energyToLoudness(momentarySum / (double) momentaryBlocks);
+        shortTermLoudness = energyToLoudness(shortTermSum / (double) shortTermBlocks);
+
+        // Every block completes a 400 ms window (overlapping the last by 75 %) for the integrated loudness
+        if (numBlocks >= momentaryBlocks && momentaryLoudness >= absoluteGate)
+        {
+            const int bin = jmin(numHistogramBins - 1, (int) ((momentaryLoudness - absoluteGate) / histogramResolution));
+            ++histogramCounts[bin];
+            histogramEnergies[bin] += momentarySum / (double) momentaryBlocks;
+
+            updateIntegratedLoudness();
+        }
+    }
+
+    void updateIntegratedLoudness()
+    {
+        double energy = 0.0, count = 0.0;
+
+        for (int bin = 0; bin < numHistogramBins; ++bin)
+        {
+            energy  += histogramEnergies[bin];
+            count   += (double) histogramCounts[bin];
+        }
+
+        const float gate = energyToLoudness(energy / count) + relativeGate;
+        const int firstBin = jlimit(0, numHistogramBins, (int) ceil((gate - absoluteGate) / histogramResolution - 0.5f));
+
+        energy = count = 0.0;
+
+        for (int bin = firstBin; bin < numHistogramBins; ++bin)
+        {
+            energy  += histogramEnergies[bin];
+            count   += (double) histogramCounts[bin];
+        }
+
+        integratedLoudness = count > 0.0 ? energyToLoudness(energy / count) : silence;
+    }
+};
@@ -0,0 +1,72 @@
+/*
+  ==============================================================================
+
+    MeterLevels.h
+
+    Output levels handed from the audio thread to the editor without locks.
+    The audio thread only pushes what was measured over each block (sum of
+    squares, peak and true peak per channel, and the loudness at its end); the
+    editor pops everything pushed since it last looked and does the meter
+    ballistics itself.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+using namespace juce;
+using namespace std;
+
+//==============================================================================
+class MeterLevels
+{
+public:
+    static constexpr int numChannels = 2;
+
+    struct Block
+    {
+        float   sumOfSquares[numChannels] {};
+        float   peak[numChannels] {};
+        float   truePeak[numChannels] {};
+        float   momentaryLoudness{-100}, shortTermLoudness{-100}, integratedLoudness{-100};  // LUFS
+        int     numSamples{0};
+        double  sampleRate{44100};
+    };
+
+    // Audio thread. While nobody reads (no editor open) the FIFO fills up; the blocks that no longer fit
+    // are dropped, and the reader is told to throw away the older ones left in it
+    void push(const Block& block)
+    {
+        const auto scope = fifo.write(1);
+
+        if (scope.blockSize1 > 0)       { blocks[(size_t) scope.startIndex1] = block; }
+        else if (scope.blockSize2 > 0)  { blocks[(size_t) scope.startIndex2] = block; }
+        else                            { overflowed.store(true, memory_order_release); }
+    }
+
+    // Message thread: calls callback(const Block&) for each block pushed since the last call, oldest first.
+    // After an overflow the FIFO only holds blocks from before the ones that were dropped, so they are
+    // skipped and the next call carries on with the current levels
+    template <typename Callback>
+    void popAll(Callback&& callback)
+    {
+        if (overflowed.exchange(false, memory_order_acquire))
+        {
+            const auto stale = fifo.read(fifo.getNumReady());
+            return;
+        }
+
+        const auto scope = fifo.read(fifo.getNumReady());
+        scope.forEach([&] (int index) { callback(blocks[(size_t) index]); });
+    }
+
+private:
+    // About 0.7 s of 16-sample blocks at 48 kHz, far more than builds up between two editor frames
+    static constexpr int        capacity = 2048;
+
+    AbstractFifo                fifo{capacity};
+    array<Block, capacity>      blocks;
+    atomic<bool>                overflowed{false};
+};
@@ -0,0 +1,1412 @@
+/*
+  ==============================================================================
+
+    PingPongDelayEngine.h
+
+    The plugin's signal chain (input gain, ping-pong delay, distortion, low pass
+    and output gain) without AudioProcessor, AudioProcessorValueTreeState or
+    buses, so it can be run directly by tools and batch jobs. It only needs the
+    juce_dsp module, and constructing one allocates nothing.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_dsp/juce_dsp.h>
+#include "DelayLineStorage.h"
+#include "DelayMemoryArena.h"
+
+using namespace juce;
+using namespace std;
+
+//==============================================================================
+// Indices of the "post_delay_option" choices
+enum PostDelayOption
+{
+    distortionOption = 0,
+    lowPassOption,
+    distortionAndLowPassOption
+};
+
+// Indices of the "delay_smoothing" choices: how the delay moves to a new delay time
+enum DelaySmoothing
+{
+    tapeSmoothing = 0,      // The delay time glides to the new value, bending the pitch like a tape delay
+    crossfadeSmoothing      // A second read head fades in at the new delay time
+};
+
+// Plain copy of every parameter, in the same units as the plugin's parameters
+struct PingPongDelayParameters
+{
+    float   inGain          = 1.0f;
+    float   delayTime       = 2.0f;         // Seconds
+    float   mix             = 0.5f;
+    float   feedback        = 0.5f;
+    int     postDelayOption = distortionOption;
+    float   distortion      = 0.5f;         // Hard clip threshold
+    int     oversampling    = 0;            // Distortion oversampling: 0 = 1x, 1 = 2x, 2 = 4x, 3 = 8x
+    float   lowpass         = 5000.0f;      // Cut-off in Hz
+    float   outGain         = 1.0f;
+    int     delaySmoothing  = crossfadeSmoothing;
+    float   smoothingTime   = 50.0f;        // Milliseconds; 0 jumps straight to a new delay time
+};
+
+//==============================================================================
+/**
+    Ping-pong delay for one or two channels: each channel's repeats are fed back
+    into the other channel. Call prepare() before processing; process() works in
+    place on any number of samples and never allocates. Storage picks the format
+    the delay line is kept in (see DelayLineStorage.h).
+*/
+template <typename SampleType, int NumChannels = 2, typename Storage = DelayStorage::Native>
+class PingPongDelayEngine
+{
+public:
+    static_assert(is_floating_point_v<SampleType>, "The engine works on float or double samples");
+    static_assert(NumChannels == 1 || NumChannels == 2, "The feedback crosses a pair of channels: use 1 (plain echo) or 2 (ping-pong)");
+
+    PingPongDelayEngine() = default;
+
+    ~PingPongDelayEngine()
+    {
+        dropPendingDelayRings();
+    }
+
+    //==============================================================================
+    // Allocates the delay line and clears all state. Delays can go up to maximumDelaySeconds, but the
+    // delay line is only sized for initialDelaySeconds: longer delays are held at its end until
+    // updateDelayBuffer() has grown it. Left out, the delay line is allocated at the maximum and never resized
+    void prepare(double sampleRate, float maximumDelaySeconds, float initialDelaySeconds = -1.0f)
+    {
+        const ScopedLock sl(delayBufferLock);
+
+        dropPendingDelayRings();
+
+        currentSampleRate = sampleRate;
+        maximumDelayFrames = jmax(1, (int) (maximumDelaySeconds * (float) sampleRate) + 1);
+
+        const int ringFrames = initialDelaySeconds < 0.0f ? maximumDelayFrames
+                                                          : getRingFrames(getRequiredFrames(initialDelaySeconds));
+
+        // reset() clears the ring, so a ring of the right size is kept as it is and a new one need not be zeroed
+        if (delayBuffer == nullptr || ringFrames != delayBufferSamples)
+        {
+            delayBufferSamples = ringFrames;
+            delayBuffer.allocate((size_t) NumChannels * (size_t) (delayBufferSamples + delayGuardSamples));
+        }
+
+        requiredDelayFrames = 0;
+        shrinkCandidateFrame = -1;
+        isDelayBufferFixed = initialDelaySeconds < 0.0f;
+
+        // The half-band filters do not depend on the sample rate, so the oversamplers only need
+        // creating once. Every factor is prepared, so switching between them never allocates
+        int maximumLatency = 1;
+
+        for (int order = 1; order <= maxOversamplingOrder; ++order)
+        {
+            auto& oversampler = oversamplers[order - 1];
+
+            if (oversampler == nullptr)
+            {
+                oversampler = make_unique<dsp::Oversampling<SampleType>>((size_t) NumChannels, (size_t) order,
+                                                                         dsp::Oversampling<SampleType>::filterHalfBandFIREquiripple,
+                                                                         true, true);
+                oversampler->initProcessing((size_t) fusedBlockSize);
+            }
+
+            maximumLatency = jmax(maximumLatency, getLatencySamples(order));
+        }
+
+        latencyBuffer.calloc((size_t) NumChannels * (size_t) maximumLatency);
+
+        reset();
+    }
+
+    // Frees the delay line and latency buffer. prepare() has to be called again before processing
+    void release()
+    {
+        const ScopedLock sl(delayBufferLock);
+
+        dropPendingDelayRings();
+        delayBuffer.free();
+        latencyBuffer.free();
+    }
+
+    // Grows the delay line when the delay time has outgrown it, and shrinks it once the delay time has
+    // needed less than half of it for a few seconds of processing. Call this every so often from a
+    // background thread, never the audio thread: it allocates and copies. The new ring is handed over to
+    // process() through an atomic pointer, which patches in the frames written during the copy
+    void updateDelayBuffer()
+    {
+        const ScopedLock sl(delayBufferLock);
+
+        delete retiredDelayRing.exchange(nullptr, memory_order_acquire);
+
+        // process() has not taken the last ring over yet, and it owns the current one until it does
+        if (delayBuffer == nullptr || isDelayBufferFixed || pendingDelayRing.load(memory_order_acquire) != nullptr) { return; }
+
+        const int64 framesWritten   = totalFramesWritten.load(memory_order_acquire);
+        const int requiredFrames    = requiredDelayFrames.load(memory_order_relaxed);
+        const int ringFrames        = getRingFrames(requiredFrames);
+
+        if (requiredFrames > delayBufferSamples)
+        {
+            shrinkCandidateFrame = -1;
+        }
+        else if (ringFrames * 2 <= delayBufferSamples)
+        {
+            // Shrinking is lazy, so a delay time that is swept down and back up again keeps its ring
+            if (shrinkCandidateFrame < 0)                                               { shrinkCandidateFrame = framesWritten; }
+            if (framesWritten - shrinkCandidateFrame < (int64) (shrinkDelaySeconds * currentSampleRate))  { return; }
+
+            shrinkCandidateFrame = -1;
+        }
+        else
+        {
+            shrinkCandidateFrame = -1;
+            return;
+        }
+
+        auto ring = make_unique<DelayRing>();
+        ring->numFrames     = ringFrames;
+        ring->copiedFrames  = framesWritten;
+        ring->frames.allocate((size_t) NumChannels * (size_t) (ringFrames + delayGuardSamples));
+
+        // The newest frames end up just behind position 0 of the new ring, the frame k frames behind the
+        // write head at newFrames - k; anything older than the current ring could hold is silence
+        const int writePosition = (int) ((framesWritten - ringStartFrame) % delayBufferSamples);
+        const int numCopied     = jmin(delayBufferSamples, ringFrames);
+        const int firstCopied   = (writePosition - numCopied + delayBufferSamples) % delayBufferSamples;
+        const int firstLength   = jmin(numCopied, delayBufferSamples - firstCopied);
+
+        StoredType* destination = ring->frames.get();
+
+        zeromem(destination, sizeof(StoredType) * (size_t) (NumChannels * (ringFrames - numCopied)));
+        destination += NumChannels * (ringFrames - numCopied);
+
+        memcpy(destination, delayBuffer.get() + NumChannels * firstCopied, sizeof(StoredType) * (size_t) (NumChannels * firstLength));
+        memcpy(destination + NumChannels * firstLength, delayBuffer.get(), sizeof(StoredType) * (size_t) (NumChannels * (numCopied - firstLength)));
+
+        pendingDelayRing.store(ring.release(), memory_order_release);
+    }
+
+    // Memory held by the delay line, for reporting
+    size_t getDelayBufferBytes() const
+    {
+        return delayBuffer != nullptr ? sizeof(StoredType) * (size_t) NumChannels * (size_t) (delayBufferSamples + delayGuardSamples) : 0;
+    }
+
+    // Parameters are picked up every numSamples samples, on a grid that runs on from the last reset()
+    // regardless of how the host splits its blocks, so automation timing and gain ramps do not depend on
+    // the block size. 0 picks them up once per call to process() instead
+    void setSubBlockSize(int numSamples)
+    {
+        subBlockSize    = jmax(0, numSamples);
+        segmentLength   = jmax(1, subBlockSize);
+        segmentPosition = 0;
+    }
+
+    // Silences the delay line and filter without reallocating
+    void reset()
+    {
+        parameters = nextParameters;
+        segmentPosition = 0;
+
+        // Start at the current delay time rather than gliding or fading to it
+        currentDelay = glideTarget = getTargetDelay();
+        glideRemaining = fadeRemaining = 0;
+
+        if (delayBuffer != nullptr)
+            zeromem(delayBuffer.get(), sizeof(StoredType) * (size_t) NumChannels * (size_t) (delayBufferSamples + delayGuardSamples));
+
+        delayWritePosition = 0;
+        totalFramesWritten = 0;
+        ringStartFrame = 0;
+
+        asleep = false;
+        quietFrames = staleFrames = 0;
+
+        for (auto& oversampler : oversamplers)
+            if (oversampler != nullptr)
+                oversampler->reset();
+
+        setActiveOversampling(jlimit(0, maxOversamplingOrder, parameters.oversampling));
+
+        zeromem(lowPassState, sizeof(lowPassState));
+        isFilterActive = false;
+
+        lastCutOff = -1.0f;
+        updateFilter();
+
+        // Start from the current gains rather than ramping from whatever was used before
+        startGain = (SampleType) parameters.inGain;
+        finalGain = (SampleType) parameters.outGain;
+    }
+
+    // Takes effect from the next segment processed (see setSubBlockSize()). Gain changes are ramped over it
+    void setParameters(const PingPongDelayParameters& newParameters)
+    {
+        nextParameters = newParameters;
+    }
+
+    const PingPongDelayParameters& getParameters() const     { return nextParameters; }
+    double getSampleRate() const                            { return currentSampleRate; }
+
+    // Delay added by a distortion oversampling setting (see PingPongDelayParameters::oversampling).
+    // The whole output is delayed by this much, whichever post delay option is selected
+    int getLatencySamples(int oversamplingOrder) const
+    {
+        if (! isPositiveAndNotGreaterThan(oversamplingOrder, maxOversamplingOrder) || oversamplingOrder == 0) { return 0; }
+
+        auto& oversampler = oversamplers[oversamplingOrder - 1];
+        return oversampler != nullptr ? roundToInt(oversampler->getLatencyInSamples()) : 0;
+    }
+
+    // How long the repeats take to fall below the silence threshold once the input stops, in seconds
+    static double getTailLengthSeconds(const PingPongDelayParameters& tailParameters)
+    {
+        if (tailParameters.delayTime <= 0.0f) { return 0.0; }
+
+        const double feedback   = jlimit(0.0, 0.999, (double) tailParameters.feedback);
+        const double repeats    = feedback > 0.0 ? ceil(log((double) silenceThreshold) / log(feedback)) : 0.0;
+
+        return (double) tailParameters.delayTime * (repeats + 1.0);
+    }
+
+    // True while the input is silent and the repeats have died away, so process() only outputs silence
+    bool isAsleep() const                                   { return asleep; }
+
+    // Processes numSamples of each of NumChannels channels in place, with the parameters last passed to
+    // setParameters()
+    void process(SampleType* const* channels, int numSamples)
+    {
+        process(channels, numSamples, [this]() -> const PingPongDelayParameters& { return nextParameters; });
+    }
+
+    // As above, but calls getParameters() for the parameters at the start of every sub-block (see
+    // setSubBlockSize()), so automation takes effect inside long blocks
+    template <typename ParameterSource>
+    void process(SampleType* const* channels, int numSamples, ParameterSource&& getParameters)
+    {
+        ScopedNoDenormals noDenormals;
+
+        for (int channel = 0; channel < NumChannels; ++channel)
+            sumOfSquares[channel] = peakLevels[channel] = 0;
+
+        if (numSamples <= 0) { return; }
+
+        jassert(delayBuffer != nullptr);   // prepare() has to be called first
+
+        // A grown or shrunk delay line from updateDelayBuffer() is taken over between blocks
+        if (auto* ring = pendingDelayRing.load(memory_order_acquire)) { adoptDelayRing(ring); }
+
+        // Without a sub-block size, the whole block is one segment
+        if (subBlockSize <= 0)
+        {
+            segmentLength = numSamples;
+            segmentPosition = 0;
+        }
+
+        // Once the input is silent and nothing audible is left in the delay line, blocks of silence only cost
+        // a peak scan
+        const bool isInputSilent = getInputPeak(channels, numSamples) < silenceThreshold;
+
+        if (asleep)
+        {
+            if (isInputSilent)
+            {
+                sleep(channels, numSamples);
+                return;
+            }
+
+            wakeUp(getParameters());
+        }
+
+        const int firstWritePosition = delayWritePosition;
+
+        // Interleaved copy of the current run, so that all channels travel through the delay and filter
+        // stages side by side in the same SIMD register
+        alignas(16) SampleType frames[NumChannels * fusedBlockSize];
+
+        for (int position = 0; position < numSamples;)
+        {
+            if (segmentPosition == 0) { beginSegment(getParameters()); }
+
+            // Run the whole chain over a few frames at a time, so that each stage finds the samples still in
+            // L1 instead of streaming the full host buffer through the cache once per stage. A run never
+            // crosses a segment boundary, as the parameters may change there
+            const int numFrames = jmin(numSamples - position, segmentLength - segmentPosition, fusedBlockSize);
+
+            // Gain ramps span the whole segment, so each run gets its share of them
+            const SampleType rampStart  = (SampleType) segmentPosition / (SampleType) segmentLength;
+            const SampleType rampEnd    = (SampleType) (segmentPosition + numFrames) / (SampleType) segmentLength;
+
+            const SampleType inGain     = (SampleType) parameters.inGain;
+            const SampleType outGain    = (SampleType) parameters.outGain;
+
+            // Gain control of input signal
+            inputGainControl(channels, position, numFrames, frames, jmap(rampStart, startGain, inGain), jmap(rampEnd, startGain, inGain));
+
+            // Pick the kernel for the post delay option once per run, so stages that are switched off are
+            // compiled out rather than run with neutral settings
+            switch (parameters.postDelayOption)
+            {
+                case distortionOption:  processDelay<true, false>(frames, numFrames);  break;
+                case lowPassOption:     processDelay<false, true>(frames, numFrames);  break;
+                default:                processDelay<true, true>(frames, numFrames);   break;
+            }
+
+            // Gain control of output signal, measuring the result on the way
+            outputGainControl(frames, channels, position, numFrames, jmap(rampStart, finalGain, outGain), jmap(rampEnd, finalGain, outGain));
+
+            position += numFrames;
+
+            if ((segmentPosition += numFrames) >= segmentLength) { segmentPosition = 0; }
+        }
+
+        updateSleep(isInputSilent, firstWritePosition, numSamples);
+    }
+
+    // Sum of the squared output samples of a channel over the last call to process()
+    SampleType getSumOfSquares(int channel) const
+    {
+        jassert(isPositiveAndBelow(channel, NumChannels));
+        return sumOfSquares[channel];
+    }
+
+    // Largest absolute output sample of a channel over the last call to process()
+    SampleType getPeakLevel(int channel) const
+    {
+        jassert(isPositiveAndBelow(channel, NumChannels));
+        return peakLevels[channel];
+    }
+
+    static SampleType hard_clip(const SampleType& sample, SampleType thresh)
+    {
+        SampleType val;
+
+        if (thresh >= 0.01)
+        {
+            if (sample < -thresh)
+                val = -thresh;
+            else if (sample > thresh)
+                val = thresh;
+            else
+                val = sample;
+        }
+        else { val = sample; }
+
+        return val;
+    }
+
+private:
+    //==============================================================================
+    using Vector = dsp::SIMDRegister<SampleType>;
+
+    // What each sample of the delay line is kept as. In the processing precision, the kernels work on the
+    // ring in place; otherwise they convert the frames they read and write through a scratch buffer
+    using StoredType = typename Storage::template Type<SampleType>;
+    static constexpr bool       isNativeStorage = is_same_v<StoredType, SampleType>;
+
+    // Number of interleaved frames held by one register
+    static constexpr int        framesPerVector = (int) Vector::size() / NumChannels;
+
+    // delayBuffer holds delayBufferSamples frames of ring plus this many frames mirroring the start of
+    // the ring, so the second interpolation tap can always read at (readPosition + 1) without wrapping
+    static constexpr int        delayGuardSamples = 1;
+
+    // Number of samples the whole chain runs over before moving on, small enough to stay in L1
+    static constexpr int        fusedBlockSize = 256;
+
+    // Frames of SampleType scratch the kernels convert the ring through: enough for a run and its
+    // interpolation tap. None is needed when the ring is stored in SampleType
+    static constexpr int        scratchFrames = isNativeStorage ? 1 : fusedBlockSize + delayGuardSamples;
+
+    // How long the delay time has to stay well below the ring before updateDelayBuffer() shrinks it
+    static constexpr double     shrinkDelaySeconds = 5.0;
+
+    // -120 dBFS: input and delay line contents below this count as silence
+    static constexpr SampleType silenceThreshold = (SampleType) 1.0e-6;
+
+    // Highest distortion oversampling setting: 2^3 = 8x
+    static constexpr int        maxOversamplingOrder = 3;
+
+    // Per-block settings shared by the delay span kernels
+    struct DelaySettings
+    {
+        SampleType  fraction, mix, feedback, threshold;
+    };
+
+    // What the delay span kernels write back to the frames
+    enum class WetStage
+    {
+        plain,          // Dry + mix * (delayed - dry)
+        clipped,        // Dry + mix * hard_clip(delayed - dry)
+        unmixed         // Only (delayed - dry), to be clipped and mixed afterwards
+    };
+
+    PingPongDelayParameters     parameters;                     // Used for the current segment
+    PingPongDelayParameters     nextParameters;                 // Set by setParameters()
+    int                         subBlockSize{0}, segmentLength{1}, segmentPosition{0};
+    double                      currentSampleRate{48000};
+    SampleType                  startGain{1}, finalGain{1};     // Input and output gain at the start of the segment
+    SampleType                  sumOfSquares[NumChannels] {};  // Output metering, accumulated by outputGainControl()
+    SampleType                  peakLevels[NumChannels] {};
+
+    // The channels of each frame are interleaved, so they share a cache line and a register. Rings come
+    // from the process-wide DelayMemoryArena rather than the heap
+    DelayMemoryBlock<StoredType> delayBuffer;
+    int                         delayBufferSamples{1}, delayWritePosition{0}, maximumDelayFrames{1};
+    uint32                      ditherState[4] { 0x9e3779b9u, 0x7f4a7c15u, 0x85ebca6bu, 0xc2b2ae35u };  // For Storage::encode()
+
+    // A delay line made by updateDelayBuffer() on a background thread, holding a copy of the current one
+    // as it was after copiedFrames frames had been written
+    struct DelayRing
+    {
+        DelayMemoryBlock<StoredType> frames;
+        int                     numFrames{0};
+        int64                   copiedFrames{0};
+    };
+
+    // Hand-over between updateDelayBuffer() and process(): the background thread publishes a new ring in
+    // pendingDelayRing, process() swaps it in and returns the old one through retiredDelayRing to be freed.
+    // delayBufferLock only keeps updateDelayBuffer() away from prepare() and release(); process() never takes it
+    atomic<DelayRing*>          pendingDelayRing{nullptr}, retiredDelayRing{nullptr};
+    atomic<int64>               totalFramesWritten{0};          // Frames written since reset(), published by process()
+    atomic<int>                 requiredDelayFrames{0};         // Ring length the current delay time needs
+    int64                       ringStartFrame{0};              // totalFramesWritten when delayWritePosition was last 0
+    int64                       shrinkCandidateFrame{-1};       // When the ring first looked too big, or -1
+    bool                        isDelayBufferFixed{false};      // Prepared at the maximum, so never resized
+    CriticalSection             delayBufferLock;
+
+    // Delay time smoothing, all in samples. The delay is kept in double, as a float cannot resolve
+    // fractions of a sample at the far end of a 4 second ring
+    double                      currentDelay{0}, glideTarget{0}, glideStep{0}, fadeFromDelay{0};
+    int                         glideRemaining{0}, fadeRemaining{0}, fadeLength{1};
+
+    // Silence detection. quietFrames counts the frames written to the delay line since the last one above
+    // silenceThreshold. Going to sleep leaves the delay line as it is; on waking, the staleFrames frames
+    // ahead of the write head (the oldest ones, which would have been overwritten with silence) are
+    // treated as zero, and only cleared once a read head can reach them
+    bool                        asleep{false};
+    int                         quietFrames{0}, staleFrames{0};
+
+    float                       lastCutOff{-1.0f};              // Cut-off the filter coefficients were last computed for
+    bool                        isFilterActive{false};          // Whether the previous block ran the low pass filter
+    SampleType                  lowPassCoefficients[5] {};      // b0, b1, b2, a1, a2 (normalised by a0)
+    SampleType                  lowPassState[2 * NumChannels] {};   // Biquad state: s1 for each channel, then s2
+
+    // Distortion oversampling, 2x, 4x and 8x. The output is delayed by the active oversampler's
+    // latency through latencyBuffer, so the dry signal lines up with the clipped one
+    unique_ptr<dsp::Oversampling<SampleType>>   oversamplers[maxOversamplingOrder];
+    HeapBlock<SampleType>       latencyBuffer;
+    int                         activeOversampling{0}, activeLatency{0}, latencyPosition{0};
+
+    //==============================================================================
+    // SIMDRegister::fromRawArray() requires aligned memory, but the delay taps sit at arbitrary
+    // offsets; going through memcpy lets the compiler emit plain unaligned loads and stores
+    static Vector loadUnaligned(const SampleType* source)
+    {
+        Vector result;
+        memcpy(&result, source, sizeof(Vector));
+        return result;
+    }
+
+    static void storeUnaligned(SampleType* destination, Vector value)
+    {
+        memcpy(destination, &value, sizeof(Vector));
+    }
+
+    // Loads a single frame into the first lanes (the others are zero)
+    static Vector loadFrame(const SampleType* source)
+    {
+        auto result = Vector::expand(0);
+        memcpy(&result, source, NumChannels * sizeof(SampleType));
+        return result;
+    }
+
+    static void storeFrame(SampleType* destination, Vector value)
+    {
+        memcpy(destination, &value, NumChannels * sizeof(SampleType));
+    }
+
+    // Moves each channel's delayed signal into the other channel's lane, which is what the ping-pong
+    // cross-feedback needs. With a single channel the signal feeds back into itself
+    static Vector crossChannels(Vector value)
+    {
+        if constexpr (NumChannels == 1)
+        {
+            return value;
+        }
+        else
+        {
+           #if JUCE_USE_SIMD && (defined (__SSE2__) || defined (_M_X64) || defined (_M_AMD64))
+            if constexpr (is_same_v<SampleType, float> && Vector::size() == 4)
+                return Vector::fromNative(_mm_shuffle_ps(value.value, value.value, _MM_SHUFFLE(2, 3, 0, 1)));
+
+            if constexpr (is_same_v<SampleType, double> && Vector::size() == 2)
+                return Vector::fromNative(_mm_shuffle_pd(value.value, value.value, 1));
+           #elif JUCE_USE_SIMD && (defined (__ARM_NEON__) || defined (__ARM_NEON) || defined (_M_ARM64))
+            // JUCE's NEON double register is an emulated pair of doubles rather than a float64x2_t, so
+            // doubles take the lane swap below
+            if constexpr (is_same_v<SampleType, float>)
+                return Vector::fromNative(vrev64q_f32(value.value));
+           #endif
+
+            Vector result;
+
+            for (size_t lane = 0; lane < Vector::size(); lane += 2)
+            {
+                result.set(lane,     value.get(lane + 1));
+                result.set(lane + 1, value.get(lane));
+            }
+
+            return result;
+        }
+    }
+
+    //==============================================================================
+    // Frames the ring needs for a delay of delaySeconds, including the interpolation tap
+    int getRequiredFrames(double delaySeconds) const
+    {
+        return jlimit(1, maximumDelayFrames, (int) ceil(delaySeconds * currentSampleRate) + 2);
+    }
+
+    // Ring length allocated for requiredFrames: a quarter and 50 ms more, so that small moves of the delay
+    // time do not need a new ring
+    int getRingFrames(int requiredFrames) const
+    {
+        return jlimit(1, maximumDelayFrames, requiredFrames + requiredFrames / 4 + (int) (0.05 * currentSampleRate));
+    }
+
+    // Frees any ring on its way between updateDelayBuffer() and process(). Only while process() is not running
+    void dropPendingDelayRings()
+    {
+        delete pendingDelayRing.exchange(nullptr);
+        delete retiredDelayRing.exchange(nullptr);
+    }
+
+    // Swaps in a ring published by updateDelayBuffer(), after copying over what was written since it was made
+    void adoptDelayRing(DelayRing* ring)
+    {
+        const int64 framesWritten   = totalFramesWritten.load(memory_order_relaxed);
+        const int numPatched        = (int) (framesWritten - ring->copiedFrames);
+        const int newFrames         = ring->numFrames;
+
+        // If the copy is older than the smaller ring, it is useless: drop it and let updateDelayBuffer() try again
+        if (numPatched < jmin(delayBufferSamples, newFrames))
+        {
+            StoredType* destination = ring->frames.get();
+
+            // As they went, those writes replaced the oldest frames of the old ring, so the copy of those may
+            // be torn: they are older than the old ring could hold by now, so they become silence
+            const int firstTorn = jmax(0, newFrames - delayBufferSamples);
+            const int lastTorn  = newFrames - delayBufferSamples + numPatched;
+
+            if (lastTorn > firstTorn)
+                zeromem(destination + NumChannels * firstTorn, sizeof(StoredType) * (size_t) (NumChannels * (lastTorn - firstTorn)));
+
+            // The frames written since the copy follow on from position 0 of the new ring
+            const int copiedWritePosition = (int) ((ring->copiedFrames - ringStartFrame) % delayBufferSamples);
+
+            for (int frame = copiedWritePosition, patched = 0; patched < numPatched;)
+            {
+                const int length = jmin(numPatched - patched, delayBufferSamples - frame);
+                memcpy(destination + NumChannels * patched, delayBuffer.get() + NumChannels * frame, sizeof(StoredType) * (size_t) (NumChannels * length));
+
+                patched += length;
+                frame = 0;
+            }
+
+            memcpy(destination + NumChannels * newFrames, destination, sizeof(StoredType) * (size_t) (NumChannels * delayGuardSamples));
+
+            // Stale frames (see wakeUp()) are the oldest ones, which keep their place ahead of the write head
+            if (staleFrames > 0) { staleFrames = jlimit(0, newFrames, newFrames - delayBufferSamples + staleFrames); }
+
+            quietFrames = jmin(quietFrames, newFrames);
+
+            delayBuffer.swapWith(ring->frames);
+            ring->numFrames     = delayBufferSamples;
+            delayBufferSamples  = newFrames;
+            delayWritePosition  = numPatched;
+            ringStartFrame      = framesWritten - numPatched;
+
+            // A shrunk ring may be shorter than a fade or glide that was still going on
+            const double longestDelay = (double) (newFrames - 1);
+            currentDelay    = jmin(currentDelay, longestDelay);
+            glideTarget     = jmin(glideTarget, longestDelay);
+            fadeFromDelay   = jmin(fadeFromDelay, longestDelay);
+        }
+
+        retiredDelayRing.store(ring, memory_order_release);
+        pendingDelayRing.store(nullptr, memory_order_release);
+    }
+
+    // numFrames frames of the ring from position on, as SampleType: the ring itself when it is stored in
+    // SampleType, otherwise a converted copy in scratch
+    const SampleType* readDelayFrames(int position, int numFrames, SampleType* scratch) const
+    {
+        if constexpr (isNativeStorage)
+        {
+            ignoreUnused(numFrames, scratch);
+            return delayBuffer.get() + NumChannels * position;
+        }
+        else
+        {
+            Storage::decode(delayBuffer.get() + NumChannels * position, scratch, NumChannels * numFrames);
+            return scratch;
+        }
+    }
+
+    // Where the frames for the ring from position on should be written: the ring itself, or scratch to be
+    // converted into it by commitDelayFrames()
+    SampleType* getDelayWriteFrames(int position, SampleType* scratch)
+    {
+        if constexpr (isNativeStorage)
+        {
+            ignoreUnused(scratch);
+            return delayBuffer.get() + NumChannels * position;
+        }
+        else
+        {
+            return scratch;
+        }
+    }
+
+    // Stores numFrames frames written to getDelayWriteFrames(position), and keeps the guard region in step
+    // with the start of the ring
+    void commitDelayFrames(int position, int numFrames, const SampleType* written)
+    {
+        if constexpr (! isNativeStorage)
+            Storage::encode(written, delayBuffer.get() + NumChannels * position, NumChannels * numFrames, ditherState);
+        else
+            ignoreUnused(written);
+
+        for (int frame = position; frame < jmin(position + numFrames, (int) delayGuardSamples); ++frame)
+        {
+            for (int channel = 0; channel < NumChannels; ++channel)
+                delayBuffer[NumChannels * (delayBufferSamples + frame) + channel] = delayBuffer[NumChannels * frame + channel];
+        }
+    }
+
+    SampleType getInputPeak(const SampleType* const* channels, int numSamples) const
+    {
+        SampleType peak = 0;
+
+        for (int channel = 0; channel < NumChannels; ++channel)
+        {
+            const auto range = FloatVectorOperations::findMinAndMax(channels[channel], numSamples);
+            peak = jmax(peak, -range.getStart(), range.getEnd());
+        }
+
+        return peak;
+    }
+
+    // Peak of numFrames frames of the delay line from firstFrame on, wrapping around the ring
+    SampleType getDelayPeak(int firstFrame, int numFrames) const
+    {
+        SampleType peak = 0;
+
+        for (int frame = firstFrame, remaining = jmin(numFrames, delayBufferSamples); remaining > 0;)
+        {
+            const int length = jmin(remaining, delayBufferSamples - frame, isNativeStorage ? remaining : (int) scratchFrames);
+
+            SampleType scratch[NumChannels * scratchFrames];
+            const auto range = FloatVectorOperations::findMinAndMax(readDelayFrames(frame, length, scratch), NumChannels * length);
+
+            peak = jmax(peak, -range.getStart(), range.getEnd());
+            remaining -= length;
+
+            if ((frame += length) >= delayBufferSamples) { frame = 0; }
+        }
+
+        return peak;
+    }
+
+    // Zeroes numFrames frames of the delay line from firstFrame on, wrapping around the ring
+    void clearDelayFrames(int firstFrame, int numFrames)
+    {
+        for (int frame = firstFrame % delayBufferSamples, remaining = numFrames; remaining > 0;)
+        {
+            const int length = jmin(remaining, delayBufferSamples - frame);
+            zeromem(delayBuffer.get() + NumChannels * frame, sizeof(StoredType) * (size_t) (NumChannels * length));
+
+            // Keep the guard region in step with the start of the ring
+            if (frame == 0)
+                zeromem(delayBuffer.get() + NumChannels * delayBufferSamples, sizeof(StoredType) * (size_t) (NumChannels * delayGuardSamples));
+
+            remaining -= length;
+            frame = 0;
+        }
+    }
+
+    // How many frames behind the write head the read heads can reach, including the interpolation tap
+    int getReadReach() const
+    {
+        const double deepestDelay = jmax(currentDelay, glideTarget, fadeRemaining > 0 ? fadeFromDelay : 0.0);
+        return (int) ceil(deepestDelay) + 1;
+    }
+
+    // Silence out while asleep. The segment grid keeps running so that automation still lands on the same
+    // samples after waking up
+    void sleep(SampleType* const* channels, int numSamples)
+    {
+        for (int channel = 0; channel < NumChannels; ++channel)
+            FloatVectorOperations::clear(channels[channel], numSamples);
+
+        segmentPosition = subBlockSize > 0 ? (segmentPosition + numSamples) % segmentLength : 0;
+    }
+
+    void wakeUp(const PingPongDelayParameters& newParameters)
+    {
+        asleep = false;
+        staleFrames = jmax(0, delayBufferSamples - quietFrames);
+        quietFrames = 0;
+
+        // Nothing audible came before this block, so pick up the latest parameters without ramping or
+        // smoothing towards them, and start the filter and oversampler from silence
+        beginSegment(newParameters);
+
+        startGain       = (SampleType) parameters.inGain;
+        finalGain       = (SampleType) parameters.outGain;
+        currentDelay    = glideTarget = getTargetDelay();
+        glideRemaining  = fadeRemaining = 0;
+
+        zeromem(lowPassState, sizeof(lowPassState));
+        setActiveOversampling(activeOversampling);
+    }
+
+    // Goes to sleep once the input is silent and enough silence has been written to the delay line that the
+    // read heads, the latency compensation and the filter can only produce silence
+    void updateSleep(bool isInputSilent, int firstWritePosition, int numSamples)
+    {
+        if (! isInputSilent || getDelayPeak(firstWritePosition, numSamples) >= silenceThreshold)
+        {
+            quietFrames = 0;
+            return;
+        }
+
+        quietFrames = jmin(delayBufferSamples, quietFrames + numSamples);
+
+        const int filterSettleFrames = (int) (0.01 * currentSampleRate);
+
+        if (quietFrames >= jmin(delayBufferSamples, getReadReach() + activeLatency + filterSettleFrames)) { asleep = true; }
+    }
+
+    //==============================================================================
+    // Applies the input gain while interleaving the channels into frames
+    void inputGainControl(const SampleType* const* channels, int startSample, int numSamples, SampleType* frames, SampleType fromGain, SampleType toGain)
+    {
+        const SampleType increment = (toGain - fromGain) / (SampleType) numSamples;
+
+        for (int channel = 0; channel < NumChannels; ++channel)
+        {
+            const SampleType* channelData = channels[channel] + startSample;
+            SampleType gain = fromGain;
+
+            for (int sample = 0; sample < numSamples; ++sample)
+            {
+                frames[NumChannels * sample + channel] = channelData[sample] * gain;
+                gain += increment;
+            }
+        }
+    }
+
+    // Applies the output gain while writing frames back to the channels, adding each channel's sum of
+    // squares to sumOfSquares and its peak to peakLevels on the way
+    void outputGainControl(SampleType* frames, SampleType* const* channels, int startSample, int numSamples, SampleType fromGain, SampleType toGain)
+    {
+        const SampleType increment = (toGain - fromGain) / (SampleType) numSamples;
+
+        // Gain and metering run over the interleaved frames a register at a time: lane l holds channel
+        // l % NumChannels of frame l / NumChannels
+        auto gains  = Vector::expand(0);
+        auto sums   = Vector::expand(0);
+        auto peaks  = Vector::expand(0);
+
+        for (size_t lane = 0; lane < Vector::size(); ++lane)
+            gains.set(lane, fromGain + increment * (SampleType) (lane / NumChannels));
+
+        const auto gainStep = Vector::expand(increment * (SampleType) framesPerVector);
+        const int numVectorFrames = numSamples - (numSamples % framesPerVector);
+
+        for (int frame = 0; frame < numVectorFrames; frame += framesPerVector)
+        {
+            const auto output = loadUnaligned(frames + NumChannels * frame) * gains;
+
+            storeUnaligned(frames + NumChannels * frame, output);
+            sums    += output * output;
+            peaks   = Vector::max(peaks, Vector::abs(output));
+            gains   += gainStep;
+        }
+
+        SampleType channelSums[NumChannels] {}, channelPeaks[NumChannels] {};
+
+        for (size_t lane = 0; lane < Vector::size(); ++lane)
+        {
+            channelSums[lane % NumChannels]     += sums.get(lane);
+            channelPeaks[lane % NumChannels]    = jmax(channelPeaks[lane % NumChannels], peaks.get(lane));
+        }
+
+        // Remaining frames that do not fill a whole register
+        for (int frame = numVectorFrames; frame < numSamples; ++frame)
+        {
+            const SampleType gain = fromGain + increment * (SampleType) frame;
+
+            for (int channel = 0; channel < NumChannels; ++channel)
+            {
+                const SampleType output = frames[NumChannels * frame + channel] * gain;
+
+                frames[NumChannels * frame + channel] = output;
+                channelSums[channel]    += output * output;
+                channelPeaks[channel]   = jmax(channelPeaks[channel], abs(output));
+            }
+        }
+
+        for (int channel = 0; channel < NumChannels; ++channel)
+        {
+            SampleType* channelData = channels[channel] + startSample;
+
+            for (int sample = 0; sample < numSamples; ++sample)
+                channelData[sample] = frames[NumChannels * sample + channel];
+
+            sumOfSquares[channel]   += channelSums[channel];
+            peakLevels[channel]     = jmax(peakLevels[channel], channelPeaks[channel]);
+        }
+    }
+
+    //==============================================================================
+    void updateFilter()
+    {
+        const float currentCutOff = parameters.lowpass;
+
+        // Nothing to do unless the cut-off moved (reset() invalidates lastCutOff when the sample rate changes)
+        if (currentCutOff == lastCutOff) { return; }
+
+        // ArrayCoefficients computes the biquad on the stack as { b0, b1, b2, a0, a1, a2 }, so nothing
+        // gets allocated on the audio thread
+        const auto coefficients = dsp::IIR::ArrayCoefficients<SampleType>::makeLowPass(currentSampleRate, (SampleType) currentCutOff, (SampleType) 0.8);
+        const SampleType a0 = coefficients[3];
+
+        lowPassCoefficients[0] = coefficients[0] / a0;
+        lowPassCoefficients[1] = coefficients[1] / a0;
+        lowPassCoefficients[2] = coefficients[2] / a0;
+        lowPassCoefficients[3] = coefficients[4] / a0;
+        lowPassCoefficients[4] = coefficients[5] / a0;
+
+        lastCutOff = currentCutOff;
+    }
+
+    // Low pass filters numFrames interleaved frames in place
+    void lpFilter(SampleType* frames, int numFrames)
+    {
+        updateFilter();
+
+        // Transposed direct form II biquad running on all channels at once: each register holds one
+        // frame, and the recursion runs frame by frame
+        const auto b0 = Vector::expand(lowPassCoefficients[0]);
+        const auto b1 = Vector::expand(lowPassCoefficients[1]);
+        const auto b2 = Vector::expand(lowPassCoefficients[2]);
+        const auto a1 = Vector::expand(lowPassCoefficients[3]);
+        const auto a2 = Vector::expand(lowPassCoefficients[4]);
+
+        auto state1 = loadFrame(lowPassState);
+        auto state2 = loadFrame(lowPassState + NumChannels);
+
+        for (int frame = 0; frame < numFrames; ++frame)
+        {
+            const auto input    = loadFrame(frames + NumChannels * frame);
+            const auto output   = b0 * input + state1;
+
+            state1 = b1 * input - a1 * output + state2;
+            state2 = b2 * input - a2 * output;
+
+            storeFrame(frames + NumChannels * frame, output);
+        }
+
+        storeFrame(lowPassState, state1);
+        storeFrame(lowPassState + NumChannels, state2);
+    }
+
+    //==============================================================================
+    // Switches to the parameters for the next segment, ramping the gains from where the last one ended
+    void beginSegment(const PingPongDelayParameters& newParameters)
+    {
+        startGain   = (SampleType) parameters.inGain;
+        finalGain   = (SampleType) parameters.outGain;
+        parameters  = newParameters;
+
+        // Tells updateDelayBuffer() how long the ring needs to be
+        const int requiredFrames = getRequiredFrames((double) parameters.delayTime);
+
+        if (requiredFrames != requiredDelayFrames.load(memory_order_relaxed)) { requiredDelayFrames.store(requiredFrames, memory_order_relaxed); }
+
+        // Every factor was prepared up front, so switching only clears some state
+        const int oversampling = jlimit(0, maxOversamplingOrder, parameters.oversampling);
+
+        if (oversampling != activeOversampling) { setActiveOversampling(oversampling); }
+    }
+
+    void setActiveOversampling(int oversamplingOrder)
+    {
+        activeOversampling  = oversamplingOrder;
+        activeLatency       = getLatencySamples(oversamplingOrder);
+        latencyPosition     = 0;
+
+        if (activeOversampling > 0) { oversamplers[activeOversampling - 1]->reset(); }
+
+        if (latencyBuffer != nullptr)
+            zeromem(latencyBuffer.get(), sizeof(SampleType) * (size_t) NumChannels * (size_t) activeLatency);
+    }
+
+    // Delays interleaved frames in place by activeLatency frames
+    void compensateLatency(SampleType* frames, int numFrames)
+    {
+        if (activeLatency == 0) { return; }
+
+        SampleType* latencyData = latencyBuffer.get();
+
+        for (int frame = 0; frame < numFrames; ++frame)
+        {
+            for (int channel = 0; channel < NumChannels; ++channel)
+                swap(frames[NumChannels * frame + channel], latencyData[NumChannels * latencyPosition + channel]);
+
+            if (++latencyPosition >= activeLatency) { latencyPosition = 0; }
+        }
+    }
+
+    // Clips the wet frames at the oversampled rate, then mixes them with the (latency compensated) dry frames
+    void distortOversampled(SampleType* frames, SampleType* dryFrames, int numFrames)
+    {
+        // dsp::Oversampling works on separate channels
+        alignas(16) SampleType wet[NumChannels][fusedBlockSize];
+        SampleType* wetChannels[NumChannels];
+
+        for (int channel = 0; channel < NumChannels; ++channel)
+        {
+            wetChannels[channel] = wet[channel];
+
+            for (int frame = 0; frame < numFrames; ++frame)
+                wet[channel][frame] = frames[NumChannels * frame + channel];
+        }
+
+        dsp::AudioBlock<SampleType> wetBlock(wetChannels, (size_t) NumChannels, (size_t) numFrames);
+
+        auto& oversampler = *oversamplers[activeOversampling - 1];
+        auto oversampledBlock = oversampler.processSamplesUp(wetBlock);
+
+        // Same rule as hard_clip(): the lowest threshold leaves the signal untouched
+        const SampleType threshold = (SampleType) parameters.distortion;
+
+        if (threshold >= 0.01)
+        {
+            for (size_t channel = 0; channel < oversampledBlock.getNumChannels(); ++channel)
+            {
+                auto* channelData = oversampledBlock.getChannelPointer(channel);
+                FloatVectorOperations::clip(channelData, channelData, -threshold, threshold, (int) oversampledBlock.getNumSamples());
+            }
+        }
+
+        oversampler.processSamplesDown(wetBlock);
+
+        compensateLatency(dryFrames, numFrames);
+
+        const SampleType mix = (SampleType) parameters.mix;
+
+        for (int frame = 0; frame < numFrames; ++frame)
+            for (int channel = 0; channel < NumChannels; ++channel)
+                frames[NumChannels * frame + channel] = dryFrames[NumChannels * frame + channel] + mix * wet[channel][frame];
+    }
+
+    //==============================================================================
+    // Delay, distortion and low pass stages for one sub-block, specialised for each post delay option
+    template <bool Distort, bool Filter>
+    void processDelay(SampleType* frames, int numFrames)
+    {
+        if constexpr (Distort)
+        {
+            if (activeOversampling > 0)
+            {
+                // The clipping runs at a higher rate on the wet signal alone, so keep the dry signal aside
+                alignas(16) SampleType dryFrames[NumChannels * fusedBlockSize];
+                memcpy(dryFrames, frames, sizeof(SampleType) * (size_t) (NumChannels * numFrames));
+
+                processDelaySpans<WetStage::unmixed>(frames, numFrames);
+                distortOversampled(frames, dryFrames, numFrames);
+            }
+            else
+            {
+                processDelaySpans<WetStage::clipped>(frames, numFrames);
+            }
+        }
+        else
+        {
+            processDelaySpans<WetStage::plain>(frames, numFrames);
+
+            // Nothing is oversampled, but the reported latency still has to hold
+            if (activeOversampling > 0) { compensateLatency(frames, numFrames); }
+        }
+
+        if constexpr (Filter)
+        {
+            // The filter did not run while it was switched off, so drop whatever state it was left with
+            if (! isFilterActive) { zeromem(lowPassState, sizeof(lowPassState)); }
+
+            lpFilter(frames, numFrames);
+        }
+
+        isFilterActive = Filter;
+    }
+
+    // Delay time the parameters ask for, in samples
+    double getTargetDelay() const
+    {
+        return jlimit(0.0, (double) (delayBufferSamples - 1), (double) parameters.delayTime * currentSampleRate);
+    }
+
+    // Starts a glide or crossfade when the delay time parameter moves
+    void updateDelayTarget()
+    {
+        const double targetDelay    = getTargetDelay();
+        const int smoothingSamples  = roundToInt((double) parameters.smoothingTime * 0.001 * currentSampleRate);
+
+        // A delay of zero switches the delay off, so there is nothing to glide or fade from or to
+        if (smoothingSamples <= 0 || targetDelay <= 0.0 || currentDelay <= 0.0)
+        {
+            currentDelay = glideTarget = targetDelay;
+            glideRemaining = fadeRemaining = 0;
+            return;
+        }
+
+        if (parameters.delaySmoothing == tapeSmoothing)
+        {
+            fadeRemaining = 0;
+
+            // Head for the new target from wherever the glide has got to
+            if (targetDelay != glideTarget || (glideRemaining == 0 && targetDelay != currentDelay))
+            {
+                glideTarget     = targetDelay;
+                glideRemaining  = smoothingSamples;
+                glideStep       = (targetDelay - currentDelay) / (double) smoothingSamples;
+            }
+        }
+        else
+        {
+            glideRemaining = 0;
+
+            // A fade in progress runs to the end; a newer target starts its own fade after it
+            if (fadeRemaining == 0 && targetDelay != currentDelay)
+            {
+                fadeFromDelay   = currentDelay;
+                currentDelay    = targetDelay;
+                fadeLength      = fadeRemaining = smoothingSamples;
+            }
+
+            glideTarget = currentDelay;
+        }
+    }
+
+    // Runs the delay line over one run of frames
+    template <WetStage Wet>
+    void processDelaySpans(SampleType* frames, int numFrames)
+    {
+        const DelaySettings settings { 0, (SampleType) parameters.mix, (SampleType) parameters.feedback, (SampleType) parameters.distortion };
+
+        updateDelayTarget();
+
+        // After waking up, clear whatever part of the stale frames the read heads could reach in this run.
+        // Reads at a delay of d land d frames behind the write head, i.e. delayBufferSamples - d frames ahead
+        if (staleFrames > 0)
+        {
+            const int firstReachable = jmax(0, delayBufferSamples - getReadReach() - 1);
+
+            if (firstReachable < staleFrames)
+            {
+                clearDelayFrames(delayWritePosition + firstReachable, staleFrames - firstReachable);
+                staleFrames = firstReachable;
+            }
+
+            // The write head overwrites the nearest ones itself
+            staleFrames = jmax(0, staleFrames - numFrames);
+        }
+
+        // Transitions read at moving or doubled positions and are handled frame by frame; once they are
+        // over, the rest of the run goes through the vectorised steady-state kernels
+        int frame = 0;
+
+        if (glideRemaining > 0)
+        {
+            frame = jmin(numFrames, glideRemaining);
+            processDelayTransition<Wet, false>(frames, frame, settings);
+        }
+        else if (fadeRemaining > 0)
+        {
+            frame = jmin(numFrames, fadeRemaining);
+            processDelayTransition<Wet, true>(frames, frame, settings);
+        }
+
+        if (frame < numFrames)
+            processSteadyDelay<Wet>(frames + NumChannels * frame, numFrames - frame, settings);
+
+        // Published after the frames are in the ring, for updateDelayBuffer() to copy up to
+        totalFramesWritten.store(totalFramesWritten.load(memory_order_relaxed) + numFrames, memory_order_release);
+    }
+
+    // Interpolated read of one frame, delay samples behind writePosition
+    void readDelayTap(double delay, int writePosition, SampleType* output) const
+    {
+        double readPosition = (double) writePosition - delay;
+
+        if (readPosition < 0.0) { readPosition += (double) delayBufferSamples; }
+
+        const int index             = jmin((int) readPosition, delayBufferSamples - 1);
+        const SampleType fraction   = (SampleType) (readPosition - (double) index);
+
+        // Reading one frame past the end of the ring lands in the guard region, which mirrors frame 0
+        SampleType scratch[2 * NumChannels];
+        const SampleType* delayed1 = readDelayFrames(index, 2, scratch);
+        const SampleType* delayed2 = delayed1 + NumChannels;
+
+        for (int channel = 0; channel < NumChannels; ++channel)
+            output[channel] = delayed1[channel] + fraction * (delayed2[channel] - delayed1[channel]);
+    }
+
+    // Frames during a delay time transition: a tape glide reads every frame at its own delay, a
+    // crossfade reads from the old and the new head and fades between them
+    template <WetStage Wet, bool Crossfade>
+    void processDelayTransition(SampleType* frames, int numFrames, const DelaySettings& settings)
+    {
+        int writePosition = delayWritePosition;
+
+        // The glide moves the delay along a straight line, laid out for the whole run at once. Counting
+        // back from the target keeps the line the same however the glide is split into runs
+        double delays[fusedBlockSize];
+
+        if constexpr (! Crossfade)
+        {
+            for (int frame = 0; frame < numFrames; ++frame)
+                delays[frame] = glideTarget - glideStep * (double) (glideRemaining - frame - 1);
+        }
+
+        for (int frame = 0; frame < numFrames; ++frame)
+        {
+            SampleType sampleOutput[NumChannels];
+
+            if constexpr (Crossfade)
+            {
+                SampleType fadingOutput[NumChannels];
+                readDelayTap(currentDelay, writePosition, sampleOutput);
+                readDelayTap(fadeFromDelay, writePosition, fadingOutput);
+
+                const SampleType gain = (SampleType) (fadeLength - fadeRemaining + frame + 1) / (SampleType) fadeLength;
+
+                for (int channel = 0; channel < NumChannels; ++channel)
+                    sampleOutput[channel] = fadingOutput[channel] + gain * (sampleOutput[channel] - fadingOutput[channel]);
+            }
+            else
+            {
+                readDelayTap(delays[frame], writePosition, sampleOutput);
+            }
+
+            SampleType scratch[NumChannels];
+            SampleType* delayInput = getDelayWriteFrames(writePosition, scratch);
+
+            processFrame<Wet>(frames + NumChannels * frame, sampleOutput, delayInput, settings);
+            commitDelayFrames(writePosition, 1, delayInput);
+
+            if (++writePosition >= delayBufferSamples) { writePosition = 0; }
+        }
+
+        delayWritePosition = writePosition;
+
+        if constexpr (Crossfade)
+        {
+            fadeRemaining -= numFrames;
+        }
+        else
+        {
+            currentDelay = (glideRemaining -= numFrames) > 0 ? delays[numFrames - 1] : glideTarget;
+        }
+    }
+
+    // Distortion, mix and feedback for one frame, given what the read head produced
+    template <WetStage Wet>
+    static void processFrame(SampleType* frameData, const SampleType* sampleOutput, SampleType* delayInput, const DelaySettings& settings)
+    {
+        SampleType sampleInput[NumChannels];
+
+        for (int channel = 0; channel < NumChannels; ++channel)
+            sampleInput[channel] = frameData[channel];
+
+        for (int channel = 0; channel < NumChannels; ++channel)
+        {
+            //==========================PROCESSING DISTORTION========================================//
+            SampleType sampleDelayDistorted = sampleOutput[channel] - sampleInput[channel];
+
+            if constexpr (Wet == WetStage::clipped)
+                sampleDelayDistorted = hard_clip(sampleDelayDistorted, settings.threshold);
+
+            //=========================MIX AND OUTPUT FOR CURRENT SAMPLE============================//
+            if constexpr (Wet == WetStage::unmixed)
+                frameData[channel] = sampleDelayDistorted;
+            else
+                frameData[channel] = sampleInput[channel] + settings.mix * sampleDelayDistorted;
+
+            // Each channel is fed back with the other channel's delayed signal
+            delayInput[channel] = sampleInput[channel] + sampleOutput[NumChannels - 1 - channel] * settings.feedback;
+        }
+    }
+
+    // Frames at a steady delay time
+    template <WetStage Wet>
+    void processSteadyDelay(SampleType* frames, int numFrames, DelaySettings settings)
+    {
+        int localWritePosition = delayWritePosition;
+
+        // The delay is constant here, so the read head trails the write head by a fixed distance: split
+        // it into whole samples and an interpolation fraction once, then advance both heads together
+        // instead of recomputing the read position for every sample
+        const int           wholeDelaySamples   = (int) currentDelay;
+        const SampleType    delayFraction       = (SampleType) (currentDelay - (double) wholeDelaySamples);
+        const bool          isDelayActive       = currentDelay > 0.0;
+
+        int         localReadPosition   = localWritePosition - wholeDelaySamples;
+        SampleType  fraction            = 0;
+
+        if (delayFraction > 0)
+        {
+            --localReadPosition;
+            fraction = 1 - delayFraction;
+        }
+
+        if (localReadPosition < 0) { localReadPosition += delayBufferSamples; }
+
+        settings.fraction = fraction;
+
+        // Perform DSP below, one span at a time: a span ends wherever the read or the write head wraps,
+        // so within it both heads address contiguous memory
+        for (int frame = 0; frame < numFrames;)
+        {
+            const int spanLength = jmin(numFrames - frame,
+                                        delayBufferSamples - localWritePosition,
+                                        delayBufferSamples - localReadPosition);
+
+            if (isDelayActive)
+            {
+                // When the delay is longer than the span, nothing read inside it was written inside it,
+                // so the frames are independent and can be processed in parallel
+                if (currentDelay > (double) spanLength)
+                    processDelaySpanSIMD<Wet>(frames + NumChannels * frame, localReadPosition, localWritePosition, spanLength, settings);
+                else
+                    processDelaySpan<Wet>(frames + NumChannels * frame, localReadPosition, localWritePosition, spanLength, settings);
+            }
+            else
+            {
+                // Without a delay there is no wet signal, and nothing is fed into the ring: clear the frames
+                // the write head passes over, so that what was there before cannot come back once the delay
+                // is raised again, and so that the sleep check sees them as quiet
+                clearDelayFrames(localWritePosition, spanLength);
+
+                if constexpr (Wet == WetStage::unmixed)
+                    zeromem(frames + NumChannels * frame, sizeof(SampleType) * (size_t) (NumChannels * spanLength));
+            }
+
+            frame += spanLength;
+
+            if ((localReadPosition += spanLength) >= delayBufferSamples)   { localReadPosition = 0; }
+            if ((localWritePosition += spanLength) >= delayBufferSamples)  { localWritePosition = 0; }
+        }
+
+        delayWritePosition = localWritePosition;
+    }
+
+    // Process a run of interleaved frames in which neither delay head wraps
+    template <WetStage Wet>
+    void processDelaySpan(SampleType* frames, int readPosition, int writePosition, int numFrames, const DelaySettings& settings)
+    {
+        for (int frame = 0; frame < numFrames; ++frame, ++readPosition, ++writePosition)
+        {
+            SampleType* frameData = frames + NumChannels * frame;
+
+            // Reading one frame past the end of the ring lands in the guard region, which mirrors frame 0.
+            // A short delay may read a frame written earlier in this span, so frames are stored one at a time
+            SampleType readScratch[2 * NumChannels], writeScratch[NumChannels];
+            const SampleType* delayed1  = readDelayFrames(readPosition, 2, readScratch);
+            const SampleType* delayed2  = delayed1 + NumChannels;
+            SampleType* delayInput      = getDelayWriteFrames(writePosition, writeScratch);
+
+            SampleType sampleOutput[NumChannels];
+
+            //================================PROCESSING DELAY==========================================//
+            for (int channel = 0; channel < NumChannels; ++channel)
+                sampleOutput[channel] = delayed1[channel] + settings.fraction * (delayed2[channel] - delayed1[channel]);
+
+            processFrame<Wet>(frameData, sampleOutput, delayInput, settings);
+            commitDelayFrames(writePosition, 1, delayInput);
+        }
+    }
+
+    // As processDelaySpan(), several frames at a time. Only valid when the delay is longer than the span
+    template <WetStage Wet>
+    void processDelaySpanSIMD(SampleType* frames, int readPosition, int writePosition, int numFrames, const DelaySettings& settings)
+    {
+        // The span is converted to and from the ring's format all at once, around the vectorised loop
+        SampleType readScratch[NumChannels * scratchFrames], writeScratch[NumChannels * scratchFrames];
+        const SampleType* readData  = readDelayFrames(readPosition, numFrames + delayGuardSamples, readScratch);
+        SampleType* writeData       = getDelayWriteFrames(writePosition, writeScratch);
+
+        // hard_clip() leaves the signal untouched below its minimum threshold
+        const SampleType clipLevel = settings.threshold >= 0.01 ? settings.threshold : numeric_limits<SampleType>::max();
+
+        const auto fraction     = Vector::expand(settings.fraction);
+        const auto mix          = Vector::expand(settings.mix);
+        const auto feedback     = Vector::expand(settings.feedback);
+        const auto upperLimit   = Vector::expand(clipLevel);
+        const auto lowerLimit   = Vector::expand(-clipLevel);
+
+        const int numVectorFrames = numFrames - (numFrames % framesPerVector);
+
+        for (int frame = 0; frame < numVectorFrames; frame += framesPerVector)
+        {
+            const int offset = NumChannels * frame;
+
+            const auto sampleInput = loadUnaligned(frames + offset);
+
+            // Delay with linear interpolation: all channels come from the same frames of the ring
+            const auto delayed1 = loadUnaligned(readData + offset);
+            const auto delayed2 = loadUnaligned(readData + offset + NumChannels);
+
+            const auto sampleOutput = delayed1 + fraction * (delayed2 - delayed1);
+
+            // Distortion
+            auto sampleDelayDistorted = sampleOutput - sampleInput;
+
+            if constexpr (Wet == WetStage::clipped)
+                sampleDelayDistorted = Vector::min(upperLimit, Vector::max(lowerLimit, sampleDelayDistorted));
+
+            // Mix and output, then feed each channel's delayed signal into the other channel's lane
+            if constexpr (Wet == WetStage::unmixed)
+                storeUnaligned(frames + offset, sampleDelayDistorted);
+            else
+                storeUnaligned(frames + offset, sampleInput + mix * sampleDelayDistorted);
+            storeUnaligned(writeData + offset, sampleInput + crossChannels(sampleOutput) * feedback);
+        }
+
+        // Remaining frames that do not fill a whole register
+        for (int frame = numVectorFrames; frame < numFrames; ++frame)
+        {
+            const int offset = NumChannels * frame;
+            SampleType sampleOutput[NumChannels];
+
+            for (int channel = 0; channel < NumChannels; ++channel)
+                sampleOutput[channel] = readData[offset + channel] + settings.fraction * (readData[offset + NumChannels + channel] - readData[offset + channel]);
+
+            processFrame<Wet>(frames + offset, sampleOutput, writeData + offset, settings);
+        }
+
+        // The delay is longer than the span, so nothing inside it reads the guard before this point
+        commitDelayFrames(writePosition, numFrames, writeData);
+    }
+};
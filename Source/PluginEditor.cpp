@@ -8,6 +8,7 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include <BinaryData.h>
 
 using namespace juce;
 using namespace std;
@@ -15,15 +16,13 @@ using namespace std;
 //==============================================================================
 PingPongDelayAudioProcessorEditor::PingPongDelayAudioProcessorEditor (PingPongDelayAudioProcessor& p)
     : AudioProcessorEditor (&p), audioProcessor (p),
-    rmsMeterLeft([&]()  { return audioProcessor.getRMSValue(0); }),
-    rmsMeterRight([&]() { return audioProcessor.getRMSValue(1); })
+    rmsMeterLeft([&]()  { return meterBallistics[0].getRMSLevel(); }, [&]() { return meterBallistics[0].getPeakLevel(); }),
+    rmsMeterRight([&]() { return meterBallistics[1].getRMSLevel(); }, [&]() { return meterBallistics[1].getPeakLevel(); })
 {
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
     buildElements();
     setSize(1200, 700);
-
-    startTimerHz(24);
 }
 
 PingPongDelayAudioProcessorEditor::~PingPongDelayAudioProcessorEditor()
@@ -32,10 +31,29 @@ PingPongDelayAudioProcessorEditor::~PingPongDelayAudioProcessorEditor()
 
 //==============================================================================
 void PingPongDelayAudioProcessorEditor::paint (juce::Graphics& g)
+{
+    // The background, frame and labels never change, so they are drawn once, at the display's pixel scale,
+    // and only copied from then on
+    const float scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+
+    if (! staticLayer.isValid() || scale != staticLayerScale)
+    {
+        staticLayerScale = scale;
+        staticLayer = Image(Image::ARGB, jmax(1, roundToInt((float) getWidth() * scale)), jmax(1, roundToInt((float) getHeight() * scale)), true);
+
+        Graphics layer(staticLayer);
+        layer.addTransform(AffineTransform::scale(scale));
+        paintStaticLayer(layer);
+    }
+
+    g.drawImage(staticLayer, getLocalBounds().toFloat());
+}
+
+void PingPongDelayAudioProcessorEditor::paintStaticLayer(Graphics& g)
 {
     Image background = ImageCache::getFromMemory(BinaryData::background_png, BinaryData::background_pngSize);
     g.drawImageAt(background, 0, 0);
-    
+
     //Draw the semi-transparent rectangle around components
     const Rectangle<float> area(20, 80, 1160, 540);
     g.setColour(Colours::ghostwhite);
@@ -77,41 +95,13 @@ void PingPongDelayAudioProcessorEditor::paint (juce::Graphics& g)
     // Title of PlugIn
     g.setFont(35.0f);
     g.drawText("Ping-Pong Delay", 20, 0, 1160, 75, Justification::centred, false);
-
-    // Hide or Display Knobs based on selection
-    if (postDelayOptions.getSelectedId() == 0)
-    {
-        postDelayOptions.setTextWhenNothingSelected("Please select an effect to apply on delayed signal...");
-
-        distortionSlider.setValue(1.0f);
-        lowpassSlider.setValue(20000.0f);
-
-        distortionSlider.setVisible(false);
-        lowpassSlider.setVisible(false);
-    }
-    else if (postDelayOptions.getSelectedId() == 1)
-    {
-        lowpassSlider.setValue(20000.0f);
-
-        distortionSlider.setVisible(true);
-        lowpassSlider.setVisible(false);
-    }
-    else if (postDelayOptions.getSelectedId() == 2)
-    {
-        distortionSlider.setValue(1.0f);
-
-        distortionSlider.setVisible(false);
-        lowpassSlider.setVisible(true);
-    }
-    else
-    {
-        distortionSlider.setVisible(true);
-        lowpassSlider.setVisible(true);
-    }
 }
 
 void PingPongDelayAudioProcessorEditor::resized()
 {
+    // Drawn again at the new size on the next paint
+    staticLayer = {};
+
     // This is generally where you'll want to lay out the positions of any subcomponents in your editor.
 
     // Input Gain Slider
@@ -120,13 +110,20 @@ void PingPongDelayAudioProcessorEditor::resized()
     // Delay Time Knob and Mix Knob
     delayTimeKnob.setBounds     ((getWidth() / 3) - 200,    (getHeight() / 2) - 250,    185, 225);
     mixKnob.setBounds           ((getWidth() / 3) - 200,    (getHeight() / 2) - 10,     185, 225);
+    syncButton.setBounds        ((getWidth() / 3) - 195,    (getHeight() / 2) - 262,    70, 25);
+    syncDivisionOptions.setBounds((getWidth() / 3) - 120,   (getHeight() / 2) - 262,    100, 25);
     feedbackSlider.setBounds    ((getWidth() / 3) + 50,     (getHeight() / 2) + 150,    350, 50);
 
+    // Delay Smoothing Mode and Time
+    smoothingOptions.setBounds  ((getWidth() / 2) - 175,    (getHeight() / 2) - 255,    185, 30);
+    smoothingTimeSlider.setBounds((getWidth() / 2) + 25,    (getHeight() / 2) - 260,    200, 40);
+
     // List of Options
     postDelayOptions.setBounds  ((getWidth() / 2) - 175,    (getHeight() / 2) - 200,    400, 50);
 
     // Distortion Knob and Low Pass Knob
     distortionSlider.setBounds  ((getWidth() / 2) - 175,    (getHeight() / 2) - 125,    185, 225);
+    oversamplingOptions.setBounds((getWidth() / 2) - 175,   (getHeight() / 2) + 105,    185, 30);
     lowpassSlider.setBounds     ((getWidth() / 2) + 50,     (getHeight() / 2) - 125,    185, 225);
 
     // Output Gain Slider
@@ -134,11 +131,39 @@ void PingPongDelayAudioProcessorEditor::resized()
 
     rmsMeterLeft.setBounds      (getWidth() - 170,          (getHeight() / 2) - 225,    35, 400);
     rmsMeterRight.setBounds     (getWidth() - 130,          (getHeight() / 2) - 225,    35, 400);
+    loudnessDisplay.setBounds   (getWidth() - 90,           (getHeight() / 2) - 225,    70, 490);
 
 }
 
-void PingPongDelayAudioProcessorEditor::timerCallback()
+void PingPongDelayAudioProcessorEditor::updateMeters(bool redraw)
 {
+    // Run the meter ballistics over every block the processor measured since the last frame. The loudness
+    // is already averaged over its windows, so only the latest matters
+    MeterLevels::Block latest;
+    bool hasLatest = false;
+    float truePeak = 0.0f;
+
+    audioProcessor.meterLevels.popAll([&] (const MeterLevels::Block& block)
+    {
+        for (int channel = 0; channel < MeterLevels::numChannels; ++channel)
+        {
+            meterBallistics[channel].addBlock(block.sumOfSquares[channel], block.peak[channel], block.numSamples, block.sampleRate);
+            truePeak = jmax(truePeak, block.truePeak[channel]);
+        }
+
+        latest = block;
+        hasLatest = true;
+    });
+
+    if (hasLatest)
+        loudnessDisplay.setLevels(latest.momentaryLoudness, latest.shortTermLoudness, latest.integratedLoudness,
+                                  Decibels::gainToDecibels(truePeak));
+
+    if (! redraw) { return; }
+
+    rmsMeterLeft.update();
+    rmsMeterRight.update();
+    loudnessDisplay.update();
 }
 
 void PingPongDelayAudioProcessorEditor::buildElements()
@@ -148,6 +173,7 @@ void PingPongDelayAudioProcessorEditor::buildElements()
 
     addAndMakeVisible(rmsMeterLeft);
     addAndMakeVisible(rmsMeterRight);
+    addAndMakeVisible(loudnessDisplay);
 
     //Building the Input Gain
     inputGainVal = make_unique<AudioProcessorValueTreeState::SliderAttachment>(audioProcessor.parameters, "inGain", inputGainSlider);
@@ -161,6 +187,15 @@ void PingPongDelayAudioProcessorEditor::buildElements()
     delayTimeKnob.setTextBoxStyle(Slider::TextBoxBelow, false, 100, 20);
     delayTimeKnob.setRange(0.0f, 4.0f); delayTimeKnob.setTextValueSuffix(" s"); addAndMakeVisible(&delayTimeKnob);
 
+    //Building the Tempo Sync Button and Division List; the Delay Time knob does nothing while synced
+    syncDivisionOptions.setEditableText(false); syncDivisionOptions.addItemList(PingPongDelayAudioProcessor::getSyncDivisionNames(), 1);
+    syncDivisionVal = make_unique<AudioProcessorValueTreeState::ComboBoxAttachment>(audioProcessor.parameters, "sync_division", syncDivisionOptions);
+    addAndMakeVisible(&syncDivisionOptions);
+
+    syncButton.onStateChange = [this] { delayTimeKnob.setEnabled(! syncButton.getToggleState()); };
+    syncVal = make_unique<AudioProcessorValueTreeState::ButtonAttachment>(audioProcessor.parameters, "sync", syncButton);
+    delayTimeKnob.setEnabled(! syncButton.getToggleState()); addAndMakeVisible(&syncButton);
+
     //Building the Mix Knob
     mixVal = make_unique<AudioProcessorValueTreeState::SliderAttachment>(audioProcessor.parameters, "mix", mixKnob);
     mixKnob.setSliderStyle(Slider::SliderStyle::RotaryHorizontalDrag);
@@ -173,9 +208,24 @@ void PingPongDelayAudioProcessorEditor::buildElements()
     feedbackSlider.setTextBoxStyle(Slider::TextBoxAbove, false, 100, 20);
     feedbackSlider.setRange(0.0f, 1.0f); addAndMakeVisible(&feedbackSlider);
 
-    //Building the ComboBox List
+    //Building the Delay Smoothing List (items first, so the attachment can select the current one)
+    StringArray smoothingChoices { "Tape", "Crossfade" };
+    smoothingOptions.setEditableText(false); smoothingOptions.addItemList(smoothingChoices, 1);
+    smoothingVal = make_unique<AudioProcessorValueTreeState::ComboBoxAttachment>(audioProcessor.parameters, "delay_smoothing", smoothingOptions);
+    addAndMakeVisible(&smoothingOptions);
+
+    //Building the Smoothing Time Slider
+    smoothingTimeVal = make_unique<AudioProcessorValueTreeState::SliderAttachment>(audioProcessor.parameters, "smoothing_time", smoothingTimeSlider);
+    smoothingTimeSlider.setSliderStyle(Slider::SliderStyle::LinearHorizontal);
+    smoothingTimeSlider.setTextBoxStyle(Slider::TextBoxRight, false, 70, 20);
+    smoothingTimeSlider.setTextValueSuffix(" ms"); addAndMakeVisible(&smoothingTimeSlider);
+
+    //Building the ComboBox List (items first, so the attachment can select the current one)
+    postDelayOptions.setEditableText(false); postDelayOptions.addItemList(choices, 1);
+    postDelayOptions.setTextWhenNothingSelected("Please select an effect to apply on delayed signal...");
     pdOptVal = make_unique<AudioProcessorValueTreeState::ComboBoxAttachment>(audioProcessor.parameters, "post_delay_option", postDelayOptions);
-    postDelayOptions.setEditableText(false); postDelayOptions.addItemList(choices, 1); addAndMakeVisible(&postDelayOptions);
+    postDelayOptions.onChange = [this] { updatePostDelayControls(); };
+    addAndMakeVisible(&postDelayOptions);
 
     //Building the Distortion Slider
     distortionVal = make_unique<AudioProcessorValueTreeState::SliderAttachment>(audioProcessor.parameters, "distortion", distortionSlider);
@@ -183,6 +233,12 @@ void PingPongDelayAudioProcessorEditor::buildElements()
     distortionSlider.setTextBoxStyle(Slider::TextBoxBelow, false, 100, 20);
     distortionSlider.setRange(0.01f, 1.0f); addChildComponent(&distortionSlider);
 
+    //Building the Oversampling List (items first, so the attachment can select the current one)
+    StringArray oversamplingChoices { "1x", "2x", "4x", "8x" };
+    oversamplingOptions.setEditableText(false); oversamplingOptions.addItemList(oversamplingChoices, 1);
+    oversamplingVal = make_unique<AudioProcessorValueTreeState::ComboBoxAttachment>(audioProcessor.parameters, "oversampling", oversamplingOptions);
+    addChildComponent(&oversamplingOptions);
+
     //Building the Low Pass Slider
     lowpassVal = make_unique<AudioProcessorValueTreeState::SliderAttachment>(audioProcessor.parameters, "lowpass", lowpassSlider);
     lowpassSlider.setSliderStyle(Slider::SliderStyle::RotaryHorizontalDrag);
@@ -194,4 +250,21 @@ void PingPongDelayAudioProcessorEditor::buildElements()
     outputGainSlider.setSliderStyle(Slider::SliderStyle::LinearVertical);
     outputGainSlider.setTextBoxStyle(Slider::TextBoxBelow, false, 100, 20);
     outputGainSlider.setRange(0.0f, 2.0f); addAndMakeVisible(&outputGainSlider);
+
+    // The distortion and low pass controls are child components, shown by the post delay option
+    updatePostDelayControls();
+}
+
+void PingPongDelayAudioProcessorEditor::updatePostDelayControls()
+{
+    // Only the controls of the stages the selected option runs are shown. The engine leaves the other
+    // stages out, so their parameters are left as they are
+    const int selectedId = postDelayOptions.getSelectedId();
+
+    const bool showDistortion   = selectedId == 1 || selectedId == 3;
+    const bool showLowPass      = selectedId == 2 || selectedId == 3;
+
+    distortionSlider.setVisible(showDistortion);
+    oversamplingOptions.setVisible(showDistortion);
+    lowpassSlider.setVisible(showLowPass);
 }
@@ -11,6 +11,7 @@
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
 #include "Components/RMSMeter.h"
+#include "Components/LoudnessDisplay.h"
 
 using namespace juce;
 using namespace std;
@@ -18,7 +19,7 @@ using namespace std;
 //==============================================================================
 /**
 */
-class PingPongDelayAudioProcessorEditor  : public juce::AudioProcessorEditor, public Timer
+class PingPongDelayAudioProcessorEditor  : public juce::AudioProcessorEditor
 {
 public:
     PingPongDelayAudioProcessorEditor (PingPongDelayAudioProcessor&);
@@ -27,18 +28,26 @@ public:
     //==============================================================================
     void paint (juce::Graphics&) override;
     void resized() override;
-    void timerCallback() override;
     void buildElements();
 
+    // Shows the distortion and low pass controls for the selected post delay option. Runs when the option
+    // changes, from the combo box or from the host through its attachment
+    void updatePostDelayControls();
+
     unique_ptr<AudioProcessorValueTreeState::SliderAttachment> inputGainVal;        // Attachment for Input Gain
 
     unique_ptr<AudioProcessorValueTreeState::SliderAttachment> delayTimeVal;        // Attachment for Delay Time
+    unique_ptr<AudioProcessorValueTreeState::ButtonAttachment> syncVal;             // Attachment for Tempo Sync
+    unique_ptr<AudioProcessorValueTreeState::ComboBoxAttachment> syncDivisionVal;   // Attachment for Sync Division
     unique_ptr<AudioProcessorValueTreeState::SliderAttachment> mixVal;              // Attachment for Delay Mix Value
     unique_ptr<AudioProcessorValueTreeState::SliderAttachment> feedbackVal;         // Attachment for Feedback Value
+    unique_ptr<AudioProcessorValueTreeState::ComboBoxAttachment> smoothingVal;      // Attachment for Delay Smoothing Mode
+    unique_ptr<AudioProcessorValueTreeState::SliderAttachment> smoothingTimeVal;    // Attachment for Smoothing Time
 
     unique_ptr<AudioProcessorValueTreeState::ComboBoxAttachment> pdOptVal;          // Attachment for Post Delay Option Value
 
     unique_ptr<AudioProcessorValueTreeState::SliderAttachment> distortionVal;       // Attachment for Distortion Value
+    unique_ptr<AudioProcessorValueTreeState::ComboBoxAttachment> oversamplingVal;   // Attachment for Distortion Oversampling
     unique_ptr<AudioProcessorValueTreeState::SliderAttachment> lowpassVal;          // Attachment for Low Pass Value
 
     unique_ptr<AudioProcessorValueTreeState::SliderAttachment> outputGainVal;       // Attachment for Output Gain
@@ -48,20 +57,44 @@ private:
     // access the processor object that created it.
     PingPongDelayAudioProcessor& audioProcessor;
 
+    // Background image, frame and labels, drawn by paintStaticLayer() into staticLayer at staticLayerScale
+    // physical pixels per point. resized() drops it; paint() draws it again when needed and copies it
+    void paintStaticLayer(Graphics& g);
+
+    Image       staticLayer;
+    float       staticLayerScale{1.0f};
+
     Slider      inputGainSlider;        // Slider for Input Gain
 
     Slider      delayTimeKnob;          // Knob for Delay Time
+    ToggleButton syncButton{"Sync"};    // Follow the host tempo instead of the Delay Time knob
+    ComboBox    syncDivisionOptions;    // Note division used while synced
     Slider      mixKnob;                // Knob for Delay Mix
     Slider      feedbackSlider;         // Slider for Feedback
+    ComboBox    smoothingOptions;       // How the delay moves to a new delay time
+    Slider      smoothingTimeSlider;    // Slider for Smoothing Time
 
     ComboBox    postDelayOptions;       // Effect options to Delayed Signal
 
     Slider      distortionSlider;       // Slider for Distortion
+    ComboBox    oversamplingOptions;    // Oversampling factor for Distortion
     Slider      lowpassSlider;          // Slider for Low Pass
 
     Slider      outputGainSlider;       // Slider for Output Gain
 
+    GUI::MeterBallistics  meterBallistics[MeterLevels::numChannels];    // Fed from audioProcessor.meterLevels in updateMeters()
     GUI::VerticalRMSMeter rmsMeterLeft, rmsMeterRight;
+    GUI::LoudnessDisplay  loudnessDisplay;                              // Output loudness, also fed in updateMeters()
+
+    // Once per display refresh: drains the processor's meter levels, even while the editor is hidden or its
+    // window minimised so that the FIFO never fills up, and, when redraw is set, lets each meter repaint
+    // what moved. Declared last, so everything it touches exists before it first runs
+    void updateMeters(bool redraw);
+
+    VBlankAttachment      vBlankAttachment{this, [this] { updateMeters(isShowing()); }};
+
+    // Paints the editor off screen, frame by frame, with and without staticLayer (Tools/EditorBenchmark)
+    friend struct EditorPaintBenchmark;
 
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PingPongDelayAudioProcessorEditor)
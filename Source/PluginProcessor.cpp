@@ -7,7 +7,10 @@
 */
 
 #include "PluginProcessor.h"
-#include "PluginEditor.h"
+
+#if ! PINGPONG_HEADLESS
+ #include "PluginEditor.h"
+#endif
 
 using namespace juce;
 using namespace std;
@@ -22,14 +25,32 @@ PingPongDelayAudioProcessor::PingPongDelayAudioProcessor()
                       #endif
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
                      #endif
-                        ), parameters(*this, nullptr, "Parameter", createParameters()),
-                           lowPassFilter(dsp::IIR::Coefficients<float>::makeLowPass(48000, 20000.0f, 0.8f))
+                        ), parameters(*this, nullptr, "Parameter", createParameters())
 #endif
 {
+    inGainParameter             = parameters.getRawParameterValue("inGain");
+    delayTimeParameter          = parameters.getRawParameterValue("delayTime");
+    mixParameter                = parameters.getRawParameterValue("mix");
+    feedbackParameter           = parameters.getRawParameterValue("feedback");
+    postDelayOptionParameter    = parameters.getRawParameterValue("post_delay_option");
+    distortionParameter         = parameters.getRawParameterValue("distortion");
+    oversamplingParameter       = parameters.getRawParameterValue("oversampling");
+    lowpassParameter            = parameters.getRawParameterValue("lowpass");
+    outGainParameter            = parameters.getRawParameterValue("outGain");
+    delaySmoothingParameter     = parameters.getRawParameterValue("delay_smoothing");
+    smoothingTimeParameter      = parameters.getRawParameterValue("smoothing_time");
+    syncParameter               = parameters.getRawParameterValue("sync");
+    syncDivisionParameter       = parameters.getRawParameterValue("sync_division");
+
+    parameters.addParameterListener("oversampling", this);
+
+    delayBufferThread->addTimeSliceClient(this);
 }
 
 PingPongDelayAudioProcessor::~PingPongDelayAudioProcessor()
 {
+    delayBufferThread->removeTimeSliceClient(this);
+    parameters.removeParameterListener("oversampling", this);
 }
 
 //==============================================================================
@@ -67,7 +88,12 @@ bool PingPongDelayAudioProcessor::isMidiEffect() const
 
 double PingPongDelayAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    // Hosts may stop calling processBlock() once the input has been silent for this long, so it covers
+    // every repeat down to the level at which the engine goes to sleep
+    auto tailParameters = getParameterSnapshot();
+    tailParameters.delayTime = jmin(tailParameters.delayTime, parameters.getParameterRange("delayTime").end);
+
+    return PingPongDelayEngine<float>::getTailLengthSeconds(tailParameters);
 }
 
 int PingPongDelayAudioProcessor::getNumPrograms()
@@ -97,32 +123,36 @@ void PingPongDelayAudioProcessor::changeProgramName (int index, const juce::Stri
 //==============================================================================
 void PingPongDelayAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    // Reset RMS Levels for new outgoing signal
-    rmslevelLeft.reset(sampleRate, 0.5);
-    rmslevelRight.reset(sampleRate, 0.5);
+    // Allocate the delay line in the precision the host is going to process in, and drop the other one.
+    // It only holds the current delay time (plus some headroom) and grows in the background, up to the
+    // longest delay the parameter allows, when the delay time is raised. An offline render runs faster
+    // than the background thread could keep up with, so it gets the whole delay line from the start
+    const float maxDelayTime = parameters.getParameterRange("delayTime").end;
 
-    rmslevelLeft.setCurrentAndTargetValue(-100.f);
-    rmslevelRight.setCurrentAndTargetValue(-100.f);
+    // The play head is only valid inside processBlock(), so a synced delay starts out from the last
+    // tempo the host reported
+    updateSyncedDelayTime();
 
-    // Reset Delay Buffer information
-    float maxDelayTime = parameters.getParameterRange("delayTime").end;
-    delayBufferChannels = getTotalNumInputChannels();
-    delayBufferSamples = (int)(maxDelayTime * (float)sampleRate) + 1;
+    const float initialDelayTime = isNonRealtime() ? -1.0f : jmin(maxDelayTime, getParameterSnapshot().delayTime);
 
-    if (delayBufferSamples < 1) { delayBufferSamples = 1; }
-
-    delayBuffer.setSize(delayBufferChannels, delayBufferSamples);
-    delayBuffer.clear();
-    delayWritePosition = 0;
+    if (isUsingDoublePrecision())
+    {
+        floatEngine.release();
+        doubleEngine.setParameters(getParameterSnapshot());
+        doubleEngine.setSubBlockSize(automationSubBlockSize);
+        doubleEngine.prepare(sampleRate, maxDelayTime, initialDelayTime);
+    }
+    else
+    {
+        doubleEngine.release();
+        floatEngine.setParameters(getParameterSnapshot());
+        floatEngine.setSubBlockSize(automationSubBlockSize);
+        floatEngine.prepare(sampleRate, maxDelayTime, initialDelayTime);
+    }
 
-    //Pre-processing for LOW PASS FILTER
-    dsp::ProcessSpec spec;
-    spec.sampleRate = sampleRate;
-    spec.maximumBlockSize = samplesPerBlock;
-    spec.numChannels = getTotalNumOutputChannels();
+    loudnessMeter.prepare(sampleRate);
 
-    lowPassFilter.prepare(spec);
-    lowPassFilter.reset();
+    updateLatency((int) oversamplingParameter->load());
 }
 
 void PingPongDelayAudioProcessor::releaseResources()
@@ -160,199 +190,189 @@ bool PingPongDelayAudioProcessor::isBusesLayoutSupported (const BusesLayout& lay
 }
 #endif
 
-void PingPongDelayAudioProcessor::updateFilter()
+PingPongDelayAudioProcessor::ParameterSnapshot PingPongDelayAudioProcessor::getParameterSnapshot() const
 {
-    auto lowpassFreq = parameters.getParameterAsValue("lowpass");
-    float currentCutOff = lowpassFreq.getValue();
-
-    *lowPassFilter.state = *dsp::IIR::Coefficients<float>::makeLowPass(lastSampleRate, currentCutOff, 0.8f);
+    ParameterSnapshot snapshot;
+
+    snapshot.inGain             = inGainParameter->load();
+    snapshot.delayTime          = syncParameter->load() >= 0.5f ? syncedDelayTime.load() : delayTimeParameter->load();
+    snapshot.mix                = mixParameter->load();
+    snapshot.feedback           = feedbackParameter->load();
+    snapshot.postDelayOption    = (int) postDelayOptionParameter->load();
+    snapshot.distortion         = distortionParameter->load();
+    snapshot.oversampling       = (int) oversamplingParameter->load();
+    snapshot.lowpass            = lowpassParameter->load();
+    snapshot.outGain            = outGainParameter->load();
+    snapshot.delaySmoothing     = (int) delaySmoothingParameter->load();
+    snapshot.smoothingTime      = smoothingTimeParameter->load();
+
+    return snapshot;
 }
 
-void PingPongDelayAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+StringArray PingPongDelayAudioProcessor::getSyncDivisionNames()
 {
-    //========= Variables ===================================//
-    ScopedNoDenormals noDenormals;
-    const int numInputChannels  = getTotalNumInputChannels();
-    const int numOutputChannels = getTotalNumOutputChannels();
-    const int numSamples        = buffer.getNumSamples();
-
-    auto dTime      = parameters.getRawParameterValue("delayTime");
-    auto mix        = parameters.getRawParameterValue("mix");
-    auto feedback   = parameters.getRawParameterValue("feedback");
-    auto distort           =  parameters.getParameterAsValue("distortion");
-
-    float currentDelayTime  = (dTime->load()) * (float)getSampleRate();
-    float currentMix        = mix->load();
-    float currentFeedback   = feedback->load();
-    float currentThreshold  = distort.getValue();
+    StringArray names;
 
-    int localWritePosition = delayWritePosition;
-
-    float* leftchannelData  = buffer.getWritePointer(0);
-    float* rightchannelData = buffer.getWritePointer(1);
-    float* leftdelayData    = delayBuffer.getWritePointer(0);
-    float* rightdelayData   = delayBuffer.getWritePointer(1);
-
-    //========== Processing =================================//
-
-    // Gain control of input signal
-    inputGainControl(buffer);
-
-    // Perform DSP below
-    for (int sample = 0; sample < numSamples; ++sample)
+    // Triplet, straight and dotted for each note value from 1/64 to a whole note, then two bars
+    for (int noteValue = 64; noteValue >= 1; noteValue /= 2)
     {
-        // Input samples for each channel
-        const float leftsampleInput = leftchannelData[sample];
-        const float rightsampleInput = rightchannelData[sample];
-
-        // Output samples for each channel
-        float leftsampleOutput = 0.0f;
-        float rightsampleOutput = 0.0f;
-
-        // Obtain the position to read and write from and to the buffer
-        float readPosition = fmodf((float)localWritePosition - currentDelayTime + (float)delayBufferSamples, delayBufferSamples);
-        int localReadPosition = floorf(readPosition);
+        const String name = "1/" + String(noteValue);
+        names.add(name + "T"); names.add(name); names.add(name + "D");
+    }
 
-        if (localReadPosition != localWritePosition)
-        {
-            //================================PROCESSING DELAY==========================================//
-            float fraction = readPosition - (float)localReadPosition;
+    names.add("2 Bars");
 
-            float delayed1L = leftdelayData[(localReadPosition + 0)];
-            float delayed1R = rightdelayData[(localReadPosition + 0)];
+    return names;
+}
 
-            float delayed2L = leftdelayData[(localReadPosition + 1) % delayBufferSamples];
-            float delayed2R = rightdelayData[(localReadPosition + 1) % delayBufferSamples];
+double PingPongDelayAudioProcessor::getSyncDivisionQuarters(int division, double quartersPerBar)
+{
+    const int numNoteValues = 7;
 
-            leftsampleOutput = delayed1L + fraction * (delayed2L - delayed1L);
-            rightsampleOutput = delayed1R + fraction * (delayed2R - delayed1R);
+    if (division >= 3 * numNoteValues) { return 2.0 * quartersPerBar; }
 
-            //==========================PROCESSING DISTORTION============================================//
-            float leftsampleDelayDistorted = hard_clip(leftsampleOutput - leftsampleInput, currentThreshold);
-            float rightsampleDelayDistorted = hard_clip(rightsampleOutput - rightsampleInput, currentThreshold);
+    const double noteQuarters   = 4.0 / (double) (64 >> (division / 3));
+    const double modifiers[]    = { 2.0 / 3.0, 1.0, 1.5 };
 
-            //=========================MIX AND OUTPUT FOR CURRENT SAMPLE================================//
-            leftchannelData[sample] = leftsampleInput + currentMix * leftsampleDelayDistorted;
-            rightchannelData[sample] = rightsampleInput + currentMix * rightsampleDelayDistorted;
+    return noteQuarters * modifiers[division % 3];
+}
 
-            leftdelayData[localWritePosition] = leftsampleInput + rightsampleOutput * currentFeedback;
-            rightdelayData[localWritePosition] = rightsampleInput + leftsampleOutput * currentFeedback;
+void PingPongDelayAudioProcessor::updateTempoSync()
+{
+    // Hosts without a play head, or that leave the tempo out, keep the last tempo they reported
+    if (auto* playHead = getPlayHead())
+    {
+        if (auto position = playHead->getPosition())
+        {
+            if (auto bpm = position->getBpm())
+            {
+                if (*bpm > 0.0) { hostBpm = *bpm; }
+            }
+
+            if (auto timeSignature = position->getTimeSignature())
+            {
+                if (timeSignature->numerator > 0 && timeSignature->denominator > 0)
+                    hostQuartersPerBar = 4.0 * timeSignature->numerator / timeSignature->denominator;
+            }
         }
-
-        if (++localWritePosition >= delayBufferSamples) { localWritePosition -= delayBufferSamples; }
-
     }
 
-    delayWritePosition = localWritePosition;
+    updateSyncedDelayTime();
+}
 
-    lpFilter(buffer);
+void PingPongDelayAudioProcessor::updateSyncedDelayTime()
+{
+    const int division = (int) syncDivisionParameter->load();
 
-    // Gain control of output signal
-    outputGainControl(buffer);
+    if (hostBpm != syncedBpm || hostQuartersPerBar != syncedQuartersPerBar || division != syncedDivision)
+    {
+        syncedBpm               = hostBpm;
+        syncedQuartersPerBar    = hostQuartersPerBar;
+        syncedDivision          = division;
 
-    // Calculate and display the RMS Meter
-    setRMSdisplay(buffer);
+        // Divisions longer than the delay line are held at its end by the engine
+        syncedDelayTime = (float) (getSyncDivisionQuarters(division, hostQuartersPerBar) * 60.0 / hostBpm);
+    }
+}
 
-    // This is here to avoid people getting screaming feedback when they first compile a plugin
-    for (auto i = numInputChannels; i < numOutputChannels; ++i) { buffer.clear(i, 0, buffer.getNumSamples()); }
+void PingPongDelayAudioProcessor::parameterChanged(const String& parameterID, float newValue)
+{
+    if (parameterID == "oversampling") { updateLatency((int) newValue); }
 }
 
-void PingPongDelayAudioProcessor::lpFilter(AudioBuffer<float>& inBuffer)
+void PingPongDelayAudioProcessor::updateLatency(int oversampling)
 {
-    dsp::AudioBlock <float> block(inBuffer);
-    updateFilter();
-    lowPassFilter.process(dsp::ProcessContextReplacing<float>(block));
+    setLatencySamples(isUsingDoublePrecision() ? doubleEngine.getLatencySamples(oversampling)
+                                               : floatEngine.getLatencySamples(oversampling));
 }
 
-float PingPongDelayAudioProcessor::hard_clip(const float& sample, float thresh)
+int PingPongDelayAudioProcessor::useTimeSlice()
 {
-    float val;
+    // Only the prepared engine has a delay line to look after
+    floatEngine.updateDelayBuffer();
+    doubleEngine.updateDelayBuffer();
 
-    if (thresh >= 0.01)
-    {
-        if (sample < -thresh)
-            val = -thresh;
-        else if (sample > thresh)
-            val = thresh;
-        else
-            val = sample;
-    }
-    else { val = sample; }
-    
-    return val;
+    return 50;
 }
 
-void PingPongDelayAudioProcessor::inputGainControl(AudioBuffer<float>& buffer)
+bool PingPongDelayAudioProcessor::supportsDoublePrecisionProcessing() const
 {
-    auto gain = parameters.getRawParameterValue("inGain");
-    float gainValue = gain->load();
-    if (gainValue == startGain)
-    {
-        buffer.applyGain(gainValue);
-    }
-    else
-    {
-        buffer.applyGainRamp(0, buffer.getNumSamples(), startGain, gainValue);
-        startGain = gainValue;
-    }
+    return true;
 }
 
-void PingPongDelayAudioProcessor::outputGainControl(AudioBuffer<float>& buffer)
+void PingPongDelayAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
-    auto gain = parameters.getRawParameterValue("outGain");
-    float gainValue = gain->load();
-    if (gainValue == finalGain)
-    {
-        buffer.applyGain(gainValue);
-    }
-    else
-    {
-        buffer.applyGainRamp(0, buffer.getNumSamples(), finalGain, gainValue);
-        finalGain = gainValue;
-    }
+    processSamples(buffer, floatEngine);
 }
 
-void PingPongDelayAudioProcessor::setRMSdisplay(juce::AudioBuffer<float>& buffer)
+void PingPongDelayAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
 {
-    rmslevelLeft.skip(buffer.getNumSamples());
-    rmslevelRight.skip(buffer.getNumSamples());
+    processSamples(buffer, doubleEngine);
+}
 
-    {
-        const auto leftlevelValue = Decibels::gainToDecibels(buffer.getRMSLevel(0, 0, buffer.getNumSamples()));
+template <typename SampleType>
+void PingPongDelayAudioProcessor::processSamples(AudioBuffer<SampleType>& buffer, PingPongDelayEngine<SampleType, 2, PluginDelayStorage>& engine)
+{
+    //========= Variables ===================================//
+    ScopedNoDenormals noDenormals;
+    const int numInputChannels  = getTotalNumInputChannels();
+    const int numOutputChannels = getTotalNumOutputChannels();
+    const int numSamples        = buffer.getNumSamples();
 
-        if (leftlevelValue < rmslevelLeft.getCurrentValue())
-        {
-            rmslevelLeft.setTargetValue(leftlevelValue);
-        }
-        else
-        {
-            rmslevelLeft.setCurrentAndTargetValue(leftlevelValue);
-        }
-    }
+    if (numSamples == 0) { return; }
 
-    {
-        const auto rightlevelValue = Decibels::gainToDecibels(buffer.getRMSLevel(1, 0, buffer.getNumSamples()));
+    // The output bus is always stereo, so the buffer holds at least the two channels the engine works on
+    jassert(buffer.getNumChannels() >= 2);
 
-        if (rightlevelValue < rmslevelLeft.getCurrentValue())
-        {
-            rmslevelRight.setTargetValue(rightlevelValue);
-        }
-        else
-        {
-            rmslevelRight.setCurrentAndTargetValue(rightlevelValue);
-        }
+    //========== Processing =================================//
+    updateTempoSync();
+
+    // The engine takes a fresh snapshot at every sub-block boundary, so automation lands on the same
+    // samples whatever block size the host uses
+    engine.process(buffer.getArrayOfWritePointers(), numSamples, [this] { return getParameterSnapshot(); });
+
+    // A sleeping engine has output digital silence, which the loudness meter does not need to filter
+    if (engine.isAsleep())  { loudnessMeter.addSilence(numSamples); }
+    else                    { loudnessMeter.process(buffer.getArrayOfReadPointers(), numSamples); }
+
+    // Hand the levels measured on the output to the meters; the editor does the ballistics
+    MeterLevels::Block levels;
+    levels.numSamples           = numSamples;
+    levels.sampleRate           = getSampleRate();
+    levels.momentaryLoudness    = loudnessMeter.getMomentaryLoudness();
+    levels.shortTermLoudness    = loudnessMeter.getShortTermLoudness();
+    levels.integratedLoudness   = loudnessMeter.getIntegratedLoudness();
+
+    for (int channel = 0; channel < MeterLevels::numChannels; ++channel)
+    {
+        levels.sumOfSquares[channel]    = (float) engine.getSumOfSquares(channel);
+        levels.peak[channel]            = (float) engine.getPeakLevel(channel);
+        levels.truePeak[channel]        = loudnessMeter.getTruePeak(channel);
     }
+
+    meterLevels.push(levels);
+
+    // This is here to avoid people getting screaming feedback when they first compile a plugin
+    for (auto i = numInputChannels; i < numOutputChannels; ++i) { buffer.clear(i, 0, buffer.getNumSamples()); }
 }
 
 //==============================================================================
 bool PingPongDelayAudioProcessor::hasEditor() const
 {
+   #if PINGPONG_HEADLESS
+    return false;   // Headless builds (benchmarks, command-line tools) are compiled without the editor
+   #else
     return true; // (change this to false if you choose to not supply an editor)
+   #endif
 }
 
 juce::AudioProcessorEditor* PingPongDelayAudioProcessor::createEditor()
 {
+   #if PINGPONG_HEADLESS
+    return nullptr;
+   #else
     return new PingPongDelayAudioProcessorEditor (*this);
+   #endif
 }
 
 //==============================================================================
@@ -373,16 +393,6 @@ void PingPongDelayAudioProcessor::setStateInformation (const void* data, int siz
     }
 }
 
-float PingPongDelayAudioProcessor::getRMSValue(const int channel) const
-{
-    // Ensuring it is a stereo input
-    jassert(channel == 0 || channel == 1);
-
-    if (channel == 0)       { return rmslevelLeft.getCurrentValue(); }
-    else if (channel == 1)  { return rmslevelRight.getCurrentValue(); }
-    else                    { return 0.f; }
-}
-
 AudioProcessorValueTreeState::ParameterLayout PingPongDelayAudioProcessor::createParameters()
 {
     // StringArray of Options
@@ -410,6 +420,22 @@ AudioProcessorValueTreeState::ParameterLayout PingPongDelayAudioProcessor::creat
     // Output Gain
     parameterVector.push_back(make_unique<AudioParameterFloat>("outGain",               "Output Gain",  0.0f, 2.0f, 1.0f));
 
+    // Distortion Oversampling: added last so existing parameter indices stay put. It changes the latency,
+    // so it is not automatable
+    StringArray oversamplingChoices { "1x", "2x", "4x", "8x" };
+    parameterVector.push_back(make_unique<AudioParameterChoice>("oversampling",         "Oversampling", oversamplingChoices, 0,
+                                                                AudioParameterChoiceAttributes().withAutomatable(false)));
+
+    // Delay Time Smoothing: how the delay moves to a new delay time, and over how long
+    StringArray smoothingChoices { "Tape", "Crossfade" };
+    parameterVector.push_back(make_unique<AudioParameterChoice>("delay_smoothing",      "Delay Smoothing", smoothingChoices, 1));
+    parameterVector.push_back(make_unique<AudioParameterFloat>("smoothing_time",        "Smoothing Time", 0.0f, 1000.0f, 50.0f));
+
+    // Tempo Sync: the delay time follows the host tempo as a note division instead of the Delay Time
+    const StringArray syncDivisions = getSyncDivisionNames();
+    parameterVector.push_back(make_unique<AudioParameterBool>("sync",                   "Tempo Sync",   false));
+    parameterVector.push_back(make_unique<AudioParameterChoice>("sync_division",        "Sync Division", syncDivisions, syncDivisions.indexOf("1/4")));
+
     return { parameterVector.begin(), parameterVector.end() };
 }
 
@@ -9,14 +9,28 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "PingPongDelayEngine.h"
+#include "MeterLevels.h"
+#include "LoudnessMeter.h"
 
 using namespace juce;
 using namespace std;
 
+// Format the plugin keeps its delay lines in (see DelayLineStorage.h): 0 = float, 1 = fp16, 2 = int16.
+// Set with a preprocessor definition in the Projucer exporter, or the PINGPONG_DELAY_STORAGE CMake option
+#ifndef PINGPONG_DELAY_STORAGE
+ #define PINGPONG_DELAY_STORAGE 0
+#endif
+
+using PluginDelayStorage = conditional_t<PINGPONG_DELAY_STORAGE == 1, DelayStorage::Half,
+                           conditional_t<PINGPONG_DELAY_STORAGE == 2, DelayStorage::Int16, DelayStorage::Native>>;
+
 //==============================================================================
 /**
 */
-class PingPongDelayAudioProcessor  : public juce::AudioProcessor
+class PingPongDelayAudioProcessor  : public juce::AudioProcessor,
+                                     private AudioProcessorValueTreeState::Listener,
+                                     private TimeSliceClient
 {
 public:
     //==============================================================================
@@ -31,19 +45,22 @@ public:
     bool isBusesLayoutSupported (const BusesLayout& layouts) const override;
    #endif
 
-    void updateFilter();
-
-    void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    // Plain copy of every parameter, taken once at the start of each block so that no stage has to
+    // go back to the AudioProcessorValueTreeState from the audio thread
+    using ParameterSnapshot = PingPongDelayParameters;
 
-    void lpFilter(AudioBuffer<float>& buffer);
+    ParameterSnapshot getParameterSnapshot() const;
 
-    float hard_clip(const float& sample, float thresh);
+    // Note divisions offered by the "sync_division" parameter, shortest first, and their length in
+    // quarter notes
+    static StringArray getSyncDivisionNames();
+    static double getSyncDivisionQuarters(int division, double quartersPerBar);
 
-    void inputGainControl(AudioBuffer<float>& buffer);
-
-    void outputGainControl(AudioBuffer<float>& buffer);
+    void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
 
-    void setRMSdisplay(juce::AudioBuffer<float>& buffer);
+    // Hosts with a 64-bit mix engine can hand over their buffers without converting them to float
+    bool supportsDoublePrecisionProcessing() const override;
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -68,25 +85,75 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
 
-    float getRMSValue(const int channel) const;
-    
-
     AudioProcessorValueTreeState    parameters;
+
+    // Output level of every block, for the editor's meters
+    MeterLevels                     meterLevels;
     
 private:
-
-    // Variables
-    LinearSmoothedValue<float>  rmslevelLeft, rmslevelRight;
-    float                       startGain, finalGain, lastSampleRate{48000};
-    int                         delayBufferSamples, delayBufferChannels, delayWritePosition;
-
-    AudioSampleBuffer           delayBuffer;
-
-    dsp::ProcessorDuplicator<dsp::IIR::Filter <float>, dsp::IIR::Coefficients <float>> lowPassFilter;
+    // Parameters are re-read every this many samples (see PingPongDelayEngine::setSubBlockSize())
+    static constexpr int        automationSubBlockSize = 32;
+
+    // All of the DSP; the processor only feeds it parameters and buffers. Only the engine for the
+    // host's processing precision is prepared
+    PingPongDelayEngine<float, 2, PluginDelayStorage>   floatEngine;
+    PingPongDelayEngine<double, 2, PluginDelayStorage>  doubleEngine;
+
+    // The engines' delay lines are sized for the delay time in use and resized off the audio thread. One
+    // background thread, shared by every instance in the process, looks at them a few times a second
+    struct DelayBufferThread : public TimeSliceThread
+    {
+        DelayBufferThread() : TimeSliceThread("PingPongDelay delay buffers")  { startThread(); }
+        ~DelayBufferThread() override                                           { stopThread(1000); }
+    };
+
+    SharedResourcePointer<DelayBufferThread> delayBufferThread;
+
+    // BS.1770 loudness and true peak of the output, for the meters
+    LoudnessMeter               loudnessMeter;
+
+    int useTimeSlice() override;
+
+    // Parameter values, looked up once in the constructor
+    atomic<float>*              inGainParameter             = nullptr;
+    atomic<float>*              delayTimeParameter          = nullptr;
+    atomic<float>*              mixParameter                = nullptr;
+    atomic<float>*              feedbackParameter           = nullptr;
+    atomic<float>*              postDelayOptionParameter    = nullptr;
+    atomic<float>*              distortionParameter         = nullptr;
+    atomic<float>*              oversamplingParameter       = nullptr;
+    atomic<float>*              lowpassParameter            = nullptr;
+    atomic<float>*              outGainParameter            = nullptr;
+    atomic<float>*              delaySmoothingParameter     = nullptr;
+    atomic<float>*              smoothingTimeParameter      = nullptr;
+    atomic<float>*              syncParameter               = nullptr;
+    atomic<float>*              syncDivisionParameter       = nullptr;
+
+    // Tempo sync. updateTempoSync() asks the play head for the tempo once per block, from processSamples()
+    // only; updateSyncedDelayTime() works the delay time out again from the last tempo reported, when the
+    // tempo, the time signature or the division has changed, and is also run by prepareToPlay(). The
+    // engine's delay smoothing carries the delay over to it. Only syncedDelayTime is read elsewhere (by
+    // getParameterSnapshot() and getTailLengthSeconds())
+    void updateTempoSync();
+    void updateSyncedDelayTime();
+
+    double                      hostBpm{120.0}, hostQuartersPerBar{4.0};
+    double                      syncedBpm{0.0}, syncedQuartersPerBar{0.0};
+    int                         syncedDivision{-1};
+    atomic<float>               syncedDelayTime{0.5f};
 
     // Functions
     AudioProcessorValueTreeState::ParameterLayout createParameters();
 
+    // Reports the latency of the distortion oversampling to the host. The "oversampling" parameter is
+    // not automatable, so this runs on the message thread when it changes
+    void parameterChanged(const String& parameterID, float newValue) override;
+    void updateLatency(int oversampling);
+
+    // Shared by both processBlock() overloads
+    template <typename SampleType>
+    void processSamples(AudioBuffer<SampleType>& buffer, PingPongDelayEngine<SampleType, 2, PluginDelayStorage>& engine);
+
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PingPongDelayAudioProcessor)
 };
@@ -0,0 +1,851 @@
+/*
+  ==============================================================================
+
+    Headless benchmark for PingPongDelayAudioProcessor::processBlock.
+
+    Runs the processor (without its editor) over a grid of sample rates, block
+    sizes and parameter settings and prints the results as JSON.
+
+    Usage: PingPongDelayBenchmark [--seconds=<audio seconds per run>] [--output=<file>]
+           PingPongDelayBenchmark --engine-check
+           PingPongDelayBenchmark --realtime-check
+
+    --engine-check runs the engine through cases that have gone wrong before and
+    fails if any of them does.
+
+    --realtime-check automates every parameter while processing, in both
+    precisions and through the engine sleeping and waking, and fails if
+    processBlock allocates or locks a mutex. It needs a build configured with
+    -DPINGPONG_REALTIME_CHECK=ON.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/PluginProcessor.h"
+
+#if PINGPONG_REALTIME_CHECK
+ #include "RealtimeCheck.h"
+#endif
+
+using namespace juce;
+using namespace std;
+
+//==============================================================================
+namespace
+{
+    const double sampleRates[]      = { 44100.0, 48000.0, 88200.0, 96000.0, 176400.0, 192000.0 };
+    const int    blockSizes[]       = { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+    const float  feedbackValues[]   = { 0.0f, 0.9f };
+    const int    oversamplingOrders = 4;     // 1x, 2x, 4x, 8x, for the options that distort
+    const int    subBlockSizes[]    = { 0, 16, 32, 64, 128 };   // 0 = parameters read once per block
+    const int    numWarmUpBlocks    = 16;
+
+    struct BenchmarkConfig
+    {
+        double  sampleRate;
+        int     blockSize;
+        int     postDelayOption;
+        float   feedback;
+        int     oversampling;
+    };
+
+    struct BenchmarkResult
+    {
+        int     numBlocks, latencySamples;
+        double  nsPerSample, p50BlockNs, p99BlockNs, maxBlockNs, realtimeFactor;
+    };
+
+    void setParameter(PingPongDelayAudioProcessor& processor, const String& parameterID, float value)
+    {
+        auto* parameter = processor.parameters.getParameter(parameterID);
+        jassert(parameter != nullptr);
+
+        parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+    }
+
+    double percentile(const vector<double>& sortedValues, double fraction)
+    {
+        if (sortedValues.empty()) { return 0.0; }
+
+        auto index = (size_t) ceil(fraction * (double) sortedValues.size());
+        return sortedValues[jlimit((size_t) 0, sortedValues.size() - 1, index > 0 ? index - 1 : 0)];
+    }
+
+    // Fills a buffer with deterministic noise so every configuration processes the same material
+    void fillWithNoise(AudioBuffer<float>& buffer)
+    {
+        Random random(0x5eed);
+
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        {
+            auto* data = buffer.getWritePointer(channel);
+
+            for (int sample = 0; sample < buffer.getNumSamples(); ++sample)
+                data[sample] = random.nextFloat() * 0.5f - 0.25f;
+        }
+    }
+
+    BenchmarkResult runBenchmark(const BenchmarkConfig& config, double secondsOfAudio)
+    {
+        PingPongDelayAudioProcessor processor;
+
+        setParameter(processor, "post_delay_option",   (float) config.postDelayOption);
+        setParameter(processor, "feedback",            config.feedback);
+        setParameter(processor, "oversampling",        (float) config.oversampling);
+
+        processor.setRateAndBufferSizeDetails(config.sampleRate, config.blockSize);
+        processor.prepareToPlay(config.sampleRate, config.blockSize);
+
+        // One second of source material, looped through the processor block by block
+        AudioBuffer<float> source(2, (int) config.sampleRate);
+        fillWithNoise(source);
+
+        AudioBuffer<float> buffer(2, config.blockSize);
+        MidiBuffer midi;
+
+        const int numBlocks = jmax(1, (int) (secondsOfAudio * config.sampleRate) / config.blockSize);
+        vector<double> blockTimesNs;
+        blockTimesNs.reserve((size_t) numBlocks);
+
+        int sourcePosition = 0;
+        double totalNs = 0.0;
+
+        for (int block = -numWarmUpBlocks; block < numBlocks; ++block)
+        {
+            if (sourcePosition + config.blockSize > source.getNumSamples()) { sourcePosition = 0; }
+
+            for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+                buffer.copyFrom(channel, 0, source, channel, sourcePosition, config.blockSize);
+
+            sourcePosition += config.blockSize;
+
+            const auto start = Time::getHighResolutionTicks();
+            processor.processBlock(buffer, midi);
+            const auto end = Time::getHighResolutionTicks();
+
+            if (block >= 0)
+            {
+                const double elapsedNs = Time::highResolutionTicksToSeconds(end - start) * 1.0e9;
+                blockTimesNs.push_back(elapsedNs);
+                totalNs += elapsedNs;
+            }
+        }
+
+        processor.releaseResources();
+
+        sort(blockTimesNs.begin(), blockTimesNs.end());
+
+        const double numSamples     = (double) numBlocks * (double) config.blockSize;
+        const double audioNs        = numSamples / config.sampleRate * 1.0e9;
+
+        BenchmarkResult result;
+        result.numBlocks        = numBlocks;
+        result.latencySamples   = processor.getLatencySamples();
+        result.nsPerSample      = totalNs / numSamples;
+        result.p50BlockNs       = percentile(blockTimesNs, 0.50);
+        result.p99BlockNs       = percentile(blockTimesNs, 0.99);
+        result.maxBlockNs       = blockTimesNs.empty() ? 0.0 : blockTimesNs.back();
+        result.realtimeFactor   = totalNs > 0.0 ? audioNs / totalNs : 0.0;
+        return result;
+    }
+
+    // Cost of re-reading the parameters every subBlockSize samples, measured on the engine alone while
+    // the delay time, mix and gains move every block as they would under automation
+    double runSubBlockBenchmark(int blockSize, int subBlockSize, double secondsOfAudio)
+    {
+        const double sampleRate = 48000.0;
+
+        PingPongDelayEngine<float> engine;
+        engine.setSubBlockSize(subBlockSize);
+        engine.prepare(sampleRate, 4.0f);
+
+        AudioBuffer<float> source(2, (int) sampleRate);
+        fillWithNoise(source);
+
+        AudioBuffer<float> buffer(2, blockSize);
+
+        PingPongDelayParameters parameters;
+        parameters.postDelayOption  = distortionAndLowPassOption;
+        parameters.feedback         = 0.9f;
+
+        int sourcePosition = 0;
+
+        auto getParameters = [&]
+        {
+            const float phase = (float) sourcePosition / (float) source.getNumSamples();
+
+            parameters.delayTime    = 0.25f + 0.05f * phase;
+            parameters.mix          = 0.3f + 0.4f * phase;
+            parameters.inGain       = 1.0f - 0.2f * phase;
+            parameters.outGain      = 0.8f + 0.2f * phase;
+            return parameters;
+        };
+
+        const int numBlocks = jmax(1, (int) (secondsOfAudio * sampleRate) / blockSize);
+        double totalNs = 0.0;
+
+        for (int block = -numWarmUpBlocks; block < numBlocks; ++block)
+        {
+            if (sourcePosition + blockSize > source.getNumSamples()) { sourcePosition = 0; }
+
+            for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+                buffer.copyFrom(channel, 0, source, channel, sourcePosition, blockSize);
+
+            sourcePosition += blockSize;
+
+            const auto start = Time::getHighResolutionTicks();
+            engine.process(buffer.getArrayOfWritePointers(), blockSize, getParameters);
+            const auto end = Time::getHighResolutionTicks();
+
+            if (block >= 0) { totalNs += Time::highResolutionTicksToSeconds(end - start) * 1.0e9; }
+        }
+
+        return totalNs / ((double) numBlocks * (double) blockSize);
+    }
+
+    var measureSubBlocks(double secondsOfAudio)
+    {
+        Array<var> entries;
+
+        for (auto blockSize : blockSizes)
+        {
+            double perBlockNs = 0.0;
+
+            for (auto subBlockSize : subBlockSizes)
+            {
+                const double nsPerSample = runSubBlockBenchmark(blockSize, subBlockSize, secondsOfAudio);
+
+                if (subBlockSize == 0) { perBlockNs = nsPerSample; }
+
+                DynamicObject::Ptr entry = new DynamicObject();
+                entry->setProperty("blockSize",          blockSize);
+                entry->setProperty("subBlockSize",       subBlockSize);
+                entry->setProperty("nsPerSample",        nsPerSample);
+                entry->setProperty("relativeToPerBlock", perBlockNs > 0.0 ? nsPerSample / perBlockNs : 1.0);
+                entries.add(var(entry.get()));
+            }
+        }
+
+        return entries;
+    }
+
+    // Average cost of constructing and preparing one instance, which is what batch jobs that spin up
+    // many instances pay per instance
+    template <typename CreateAndPrepare>
+    double measureConstructionNs(CreateAndPrepare&& createAndPrepare)
+    {
+        const int numInstances = 100;
+
+        const auto start = Time::getHighResolutionTicks();
+
+        for (int i = 0; i < numInstances; ++i)
+            createAndPrepare();
+
+        const auto end = Time::getHighResolutionTicks();
+        return Time::highResolutionTicksToSeconds(end - start) * 1.0e9 / numInstances;
+    }
+
+    var measureConstruction()
+    {
+        const double sampleRate = 48000.0;
+        const int blockSize = 512;
+
+        DynamicObject::Ptr entry = new DynamicObject();
+
+        entry->setProperty("processorNs", measureConstructionNs([&]
+        {
+            PingPongDelayAudioProcessor processor;
+            processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+            processor.prepareToPlay(sampleRate, blockSize);
+        }));
+
+        entry->setProperty("engineNs", measureConstructionNs([&]
+        {
+            PingPongDelayEngine<float> engine;
+            engine.prepare(sampleRate, 4.0f);
+        }));
+
+        // The plugin sizes the delay line for the current delay time (2 s by default) instead of the 4 s maximum
+        entry->setProperty("rightSizedEngineNs", measureConstructionNs([&]
+        {
+            PingPongDelayEngine<float> engine;
+            engine.prepare(sampleRate, 4.0f, 2.0f);
+        }));
+
+        PingPongDelayEngine<float> engine;
+        engine.prepare(sampleRate, 4.0f);
+        entry->setProperty("delayBufferBytes", (int64) engine.getDelayBufferBytes());
+
+        engine.prepare(sampleRate, 4.0f, 2.0f);
+        entry->setProperty("rightSizedDelayBufferBytes", (int64) engine.getDelayBufferBytes());
+        engine.release();
+
+        // A session's worth of instances: their delay lines share a few slabs of the DelayMemoryArena, which
+        // are all given back once the session is closed, and loading it again reserves as much as the first time
+        const int numSessionInstances = 100;
+        vector<unique_ptr<PingPongDelayAudioProcessor>> session;
+
+        auto loadSession = [&]
+        {
+            for (int i = 0; i < numSessionInstances; ++i)
+            {
+                session.push_back(make_unique<PingPongDelayAudioProcessor>());
+                session.back()->setRateAndBufferSizeDetails(sampleRate, blockSize);
+                session.back()->prepareToPlay(sampleRate, blockSize);
+            }
+        };
+
+        loadSession();
+        const auto loaded = DelayMemoryArena::getInstance().getFootprint();
+
+        session.clear();
+        const auto closed = DelayMemoryArena::getInstance().getFootprint();
+
+        loadSession();
+        const auto reloaded = DelayMemoryArena::getInstance().getFootprint();
+        session.clear();
+
+        entry->setProperty("sessionInstances",               numSessionInstances);
+        entry->setProperty("arenaSlabs",                     loaded.numSlabs);
+        entry->setProperty("arenaReservedBytes",             (int64) loaded.reservedBytes);
+        entry->setProperty("arenaUsedBytes",                 (int64) loaded.usedBytes);
+        entry->setProperty("arenaReservedBytesWhenClosed",   (int64) closed.reservedBytes);
+        entry->setProperty("arenaReservedBytesAfterReload",  (int64) reloaded.reservedBytes);
+
+        return var(entry.get());
+    }
+
+    // Runs the engine with its delay line kept in Storage over the benchmark noise, leaving the output in
+    // output and returning the processing time in ns/sample
+    template <typename Storage>
+    double runStorageBenchmark(float feedback, double secondsOfAudio, AudioBuffer<float>& output, size_t& delayBufferBytes)
+    {
+        const double sampleRate = 48000.0;
+        const int blockSize = 512;
+
+        PingPongDelayParameters parameters;
+        parameters.delayTime        = 0.25f;
+        parameters.feedback         = feedback;
+        parameters.postDelayOption  = lowPassOption;
+
+        PingPongDelayEngine<float, 2, Storage> engine;
+        engine.setParameters(parameters);
+        engine.prepare(sampleRate, 4.0f);
+        delayBufferBytes = engine.getDelayBufferBytes();
+
+        AudioBuffer<float> source(2, (int) sampleRate);
+        fillWithNoise(source);
+
+        const int numBlocks = jmax(1, (int) (secondsOfAudio * sampleRate) / blockSize);
+        output.setSize(2, numBlocks * blockSize);
+
+        double totalNs = 0.0;
+
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            const int position = block * blockSize;
+            float* channels[2];
+
+            for (int channel = 0; channel < 2; ++channel)
+            {
+                output.copyFrom(channel, position, source, channel, position % (source.getNumSamples() - blockSize), blockSize);
+                channels[channel] = output.getWritePointer(channel, position);
+            }
+
+            const auto start = Time::getHighResolutionTicks();
+            engine.process(channels, blockSize);
+            const auto end = Time::getHighResolutionTicks();
+
+            totalNs += Time::highResolutionTicksToSeconds(end - start) * 1.0e9;
+        }
+
+        return totalNs / ((double) numBlocks * (double) blockSize);
+    }
+
+    // Speed of each delay line format, and a null test against the float delay line: the peak and RMS of
+    // the difference in output, in dBFS, next to the RMS of the output itself
+    var measureDelayStorage(double secondsOfAudio)
+    {
+        Array<var> entries;
+
+        for (auto feedback : feedbackValues)
+        {
+            AudioBuffer<float> reference, output;
+            size_t delayBufferBytes = 0;
+
+            auto addEntry = [&] (const char* name, double nsPerSample)
+            {
+                double peakError = 0.0, sumOfErrorSquares = 0.0, sumOfSquares = 0.0;
+
+                for (int channel = 0; channel < 2; ++channel)
+                {
+                    for (int sample = 0; sample < output.getNumSamples(); ++sample)
+                    {
+                        const double error = (double) output.getSample(channel, sample) - (double) reference.getSample(channel, sample);
+
+                        peakError = jmax(peakError, abs(error));
+                        sumOfErrorSquares += error * error;
+                        sumOfSquares += (double) reference.getSample(channel, sample) * (double) reference.getSample(channel, sample);
+                    }
+                }
+
+                const double numSamples = 2.0 * (double) output.getNumSamples();
+
+                DynamicObject::Ptr entry = new DynamicObject();
+                entry->setProperty("format",             name);
+                entry->setProperty("feedback",           feedback);
+                entry->setProperty("nsPerSample",        nsPerSample);
+                entry->setProperty("delayBufferBytes",   (int64) delayBufferBytes);
+                entry->setProperty("outputRmsDb",        Decibels::gainToDecibels(sqrt(sumOfSquares / numSamples), -200.0));
+                entry->setProperty("nullPeakDb",         Decibels::gainToDecibels(peakError, -200.0));
+                entry->setProperty("nullRmsDb",          Decibels::gainToDecibels(sqrt(sumOfErrorSquares / numSamples), -200.0));
+                entries.add(var(entry.get()));
+            };
+
+            const double floatNs = runStorageBenchmark<DelayStorage::Native>(feedback, secondsOfAudio, reference, delayBufferBytes);
+            output.makeCopyOf(reference);
+            addEntry(DelayStorage::Native::name, floatNs);
+
+            const double halfNs = runStorageBenchmark<DelayStorage::Half>(feedback, secondsOfAudio, output, delayBufferBytes);
+            addEntry(DelayStorage::Half::name, halfNs);
+
+            const double int16Ns = runStorageBenchmark<DelayStorage::Int16>(feedback, secondsOfAudio, output, delayBufferBytes);
+            addEntry(DelayStorage::Int16::name, int16Ns);
+        }
+
+        return entries;
+    }
+
+    // Cost of the processor's loudness meter on its own, per stereo sample, at each sample rate: measuring
+    // the benchmark noise, and moving on over silence while the engine sleeps. percentOfCore is the share
+    // of one core it takes in real time
+    var measureLoudness(double secondsOfAudio)
+    {
+        Array<var> entries;
+        const int blockSize = 512;
+
+        for (auto sampleRate : sampleRates)
+        {
+            LoudnessMeter meter;
+            meter.prepare(sampleRate);
+
+            AudioBuffer<float> source(2, (int) sampleRate);
+            fillWithNoise(source);
+
+            const int numBlocks = jmax(1, (int) (secondsOfAudio * sampleRate) / blockSize);
+            double measuringNs = 0.0, silentNs = 0.0;
+
+            for (int block = -numWarmUpBlocks; block < numBlocks; ++block)
+            {
+                const int position = (jmax(0, block) * blockSize) % (source.getNumSamples() - blockSize);
+                const float* channels[2] = { source.getReadPointer(0, position), source.getReadPointer(1, position) };
+
+                const auto start = Time::getHighResolutionTicks();
+                meter.process(channels, blockSize);
+                const auto end = Time::getHighResolutionTicks();
+
+                if (block >= 0) { measuringNs += Time::highResolutionTicksToSeconds(end - start) * 1.0e9; }
+            }
+
+            for (int block = 0; block < numBlocks; ++block)
+            {
+                const auto start = Time::getHighResolutionTicks();
+                meter.addSilence(blockSize);
+                const auto end = Time::getHighResolutionTicks();
+
+                silentNs += Time::highResolutionTicksToSeconds(end - start) * 1.0e9;
+            }
+
+            const double nsPerSample = measuringNs / ((double) numBlocks * (double) blockSize);
+
+            DynamicObject::Ptr entry = new DynamicObject();
+            entry->setProperty("sampleRate",         sampleRate);
+            entry->setProperty("nsPerSample",        nsPerSample);
+            entry->setProperty("silentNsPerSample",  silentNs / ((double) numBlocks * (double) blockSize));
+            entry->setProperty("percentOfCore",      nsPerSample * sampleRate * 1.0e-7);
+            entry->setProperty("integratedLufs",     meter.getIntegratedLoudness());
+            entries.add(var(entry.get()));
+        }
+
+        return entries;
+    }
+
+    var toJson(const BenchmarkConfig& config, const BenchmarkResult& result, const StringArray& optionNames)
+    {
+        DynamicObject::Ptr entry = new DynamicObject();
+        entry->setProperty("sampleRate",         config.sampleRate);
+        entry->setProperty("blockSize",          config.blockSize);
+        entry->setProperty("postDelayOption",    optionNames[config.postDelayOption]);
+        entry->setProperty("feedback",           config.feedback);
+        entry->setProperty("oversampling",       1 << config.oversampling);
+        entry->setProperty("latencySamples",     result.latencySamples);
+        entry->setProperty("blocks",             result.numBlocks);
+        entry->setProperty("nsPerSample",        result.nsPerSample);
+        entry->setProperty("p50BlockNs",         result.p50BlockNs);
+        entry->setProperty("p99BlockNs",         result.p99BlockNs);
+        entry->setProperty("maxBlockNs",         result.maxBlockNs);
+        entry->setProperty("realtimeFactor",     result.realtimeFactor);
+        return var(entry.get());
+    }
+
+    //==============================================================================
+    // Feeds a loud signal with plenty of feedback into a delay line sized for it, then drops the delay time
+    // to 0 and the input to silence. Nothing can be heard any more, so the engine has to go to sleep
+    template <typename SampleType>
+    bool checkSleepWithoutDelay()
+    {
+        const double sampleRate = 48000.0;
+        const int blockSize = 480;
+
+        PingPongDelayParameters parameters;
+        parameters.delayTime        = 0.25f;
+        parameters.feedback         = 0.8f;
+        parameters.postDelayOption  = lowPassOption;
+
+        PingPongDelayEngine<SampleType> engine;
+        engine.setParameters(parameters);
+        engine.prepare(sampleRate, 4.0f, parameters.delayTime);
+
+        AudioBuffer<float> noise(2, blockSize);
+        fillWithNoise(noise);
+
+        AudioBuffer<SampleType> buffer(2, blockSize);
+
+        for (int block = 0; block < 100; ++block)
+        {
+            for (int channel = 0; channel < 2; ++channel)
+                for (int sample = 0; sample < blockSize; ++sample)
+                    buffer.setSample(channel, sample, (SampleType) noise.getSample(channel, sample));
+
+            engine.process(buffer.getArrayOfWritePointers(), blockSize);
+        }
+
+        parameters.delayTime = 0.0f;
+        engine.setParameters(parameters);
+
+        // A tenth of a second is far longer than the filters take to settle
+        for (int block = 0; block < 10; ++block)
+        {
+            buffer.clear();
+            engine.process(buffer.getArrayOfWritePointers(), blockSize);
+        }
+
+        return engine.isAsleep();
+    }
+
+    // Offline, the processor is fed faster than real time and its delay line cannot wait to be grown in the
+    // background. Raises the delay time from 0.1 s to 3 s in the block that carries an impulse, and
+    // requires the first repeat to come out 3 s later
+    bool checkDelayJumpOffline()
+    {
+        const double sampleRate = 48000.0;
+        const int blockSize = 512;
+        const float delayTime = 3.0f;
+
+        PingPongDelayAudioProcessor processor;
+        setParameter(processor, "delayTime",           0.1f);
+        setParameter(processor, "mix",                 1.0f);
+        setParameter(processor, "feedback",            0.0f);
+        setParameter(processor, "post_delay_option",   (float) lowPassOption);
+        setParameter(processor, "lowpass",             20000.0f);
+        setParameter(processor, "smoothing_time",      0.0f);
+
+        processor.setNonRealtime(true);
+        processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+        processor.prepareToPlay(sampleRate, blockSize);
+
+        AudioBuffer<float> buffer(2, blockSize);
+        MidiBuffer midi;
+
+        buffer.clear();
+        processor.processBlock(buffer, midi);
+
+        setParameter(processor, "delayTime", delayTime);
+
+        const int expectedPosition = roundToInt(delayTime * sampleRate) + processor.getLatencySamples();
+        int loudestPosition = -1;
+        float loudest = 0.0f;
+
+        for (int position = 0; position < expectedPosition + sampleRate; position += blockSize)
+        {
+            buffer.clear();
+
+            if (position == 0)
+            {
+                buffer.setSample(0, 0, 1.0f);
+                buffer.setSample(1, 0, 1.0f);
+            }
+
+            processor.processBlock(buffer, midi);
+
+            for (int sample = 0; sample < blockSize; ++sample)
+            {
+                const float level = abs(buffer.getSample(0, sample)) + abs(buffer.getSample(1, sample));
+
+                if (level > loudest)
+                {
+                    loudest = level;
+                    loudestPosition = position + sample;
+                }
+            }
+        }
+
+        processor.releaseResources();
+
+        // The low pass spreads the impulse over a few samples
+        return abs(loudestPosition - expectedPosition) <= 4;
+    }
+
+    // Decodes every fp16 bit pattern with denormals flushed to zero, as on the audio thread, through the
+    // vectorised decode() and the scalar toFloat() its tail uses. The two have to agree bit for bit, and
+    // every finite half has to come out as its exact value
+    bool checkHalfDecoding()
+    {
+        const ScopedNoDenormals noDenormals;
+
+        const int numPatterns = 1 << 16;
+        vector<uint16> halves((size_t) numPatterns);
+        vector<float> decoded((size_t) numPatterns);
+
+        for (int pattern = 0; pattern < numPatterns; ++pattern)
+            halves[(size_t) pattern] = (uint16) pattern;
+
+        DelayStorage::Half::decode(halves.data(), decoded.data(), numPatterns);
+
+        for (int pattern = 0; pattern < numPatterns; ++pattern)
+        {
+            const float scalar = DelayStorage::Half::toFloat((uint16) pattern);
+
+            if (memcmp(&scalar, &decoded[(size_t) pattern], sizeof(float)) != 0) { return false; }
+
+            const int exponent = (pattern >> 10) & 0x1f;
+            const int mantissa = pattern & 0x3ff;
+
+            if (exponent == 0x1f) { continue; }
+
+            const double magnitude  = exponent == 0 ? ldexp((double) mantissa, -24) : ldexp((double) (mantissa | 0x400), exponent - 25);
+            const double exact      = (pattern & 0x8000) != 0 ? -magnitude : magnitude;
+
+            if ((double) scalar != exact || signbit(scalar) != ((pattern & 0x8000) != 0)) { return false; }
+        }
+
+        return true;
+    }
+
+    int runEngineChecks()
+    {
+        struct EngineCheck
+        {
+            const char* name;
+            bool (*run)();
+        };
+
+        const EngineCheck checks[] =
+        {
+            { "sleep without a delay (float)",     checkSleepWithoutDelay<float> },
+            { "sleep without a delay (double)",    checkSleepWithoutDelay<double> },
+            { "delay raised offline",              checkDelayJumpOffline },
+            { "fp16 decoding without denormals",   checkHalfDecoding },
+        };
+
+        int numFailures = 0;
+
+        for (const auto& check : checks)
+        {
+            const bool passed = check.run();
+            cout << (passed ? "passed: " : "FAILED: ") << check.name << endl;
+
+            if (! passed) { ++numFailures; }
+        }
+
+        return numFailures == 0 ? 0 : 1;
+    }
+
+   #if PINGPONG_REALTIME_CHECK
+    // Processes a few seconds of audio in one precision while moving all 13 parameters between blocks and
+    // varying the block size, as a host would. The first half feeds noise; the second half feeds short
+    // bursts between stretches of silence with little feedback, so the engine goes to sleep and wakes up
+    // again. Returns the number of blocks whose output was entirely silent, which shows that it slept
+    template <typename SampleType>
+    int runRealtimeCheck(AudioProcessor::ProcessingPrecision precision)
+    {
+        const double sampleRate = 48000.0;
+        const int maximumBlockSize = 512;
+
+        PingPongDelayAudioProcessor processor;
+        processor.setProcessingPrecision(precision);
+        processor.setRateAndBufferSizeDetails(sampleRate, maximumBlockSize);
+        processor.prepareToPlay(sampleRate, maximumBlockSize);
+
+        AudioBuffer<float> noise(2, maximumBlockSize);
+        fillWithNoise(noise);
+
+        AudioBuffer<SampleType> source(2, maximumBlockSize);
+
+        for (int channel = 0; channel < 2; ++channel)
+            for (int sample = 0; sample < maximumBlockSize; ++sample)
+                source.setSample(channel, sample, (SampleType) noise.getSample(channel, sample));
+
+        const int numDivisions = PingPongDelayAudioProcessor::getSyncDivisionNames().size();
+
+        AudioBuffer<SampleType> buffer(2, maximumBlockSize);
+        MidiBuffer midi;
+        Random random(0xa770);
+
+        const int64 numSamplesToProcess = (int64) (16.0 * sampleRate);
+        const int64 burstPeriod         = (int64) (2.5 * sampleRate);
+        const int64 burstLength         = (int64) (0.05 * sampleRate);
+
+        int numBlocks = 0, numSilentBlocks = 0;
+
+        for (int64 position = 0; position < numSamplesToProcess; ++numBlocks)
+        {
+            const float phase = (float) position / (float) numSamplesToProcess;
+            const bool isSleepPhase = position >= numSamplesToProcess / 2;
+
+            setParameter(processor, "inGain",              1.0f + 0.5f * sin(MathConstants<float>::twoPi * phase * 3.0f));
+            setParameter(processor, "delayTime",           isSleepPhase ? 0.001f + 0.1f * random.nextFloat() : 0.001f + 0.5f * phase);
+            setParameter(processor, "mix",                 random.nextFloat());
+            setParameter(processor, "feedback",            (isSleepPhase ? 0.3f : 0.9f) * random.nextFloat());
+            setParameter(processor, "post_delay_option",   (float) (numBlocks % 3));
+            setParameter(processor, "distortion",          0.01f + 0.99f * random.nextFloat());
+            setParameter(processor, "oversampling",        (float) ((numBlocks / 3) % 4));
+            setParameter(processor, "lowpass",             1000.0f + 19000.0f * random.nextFloat());
+            setParameter(processor, "outGain",             1.0f - 0.5f * phase);
+            setParameter(processor, "delay_smoothing",     (float) ((numBlocks / 5) % 2));
+            setParameter(processor, "smoothing_time",      1000.0f * random.nextFloat());
+
+            // Synced divisions can be far longer than the sleep phase's delay times, so sync only before it
+            setParameter(processor, "sync",                (! isSleepPhase && (numBlocks / 40) % 2 == 1) ? 1.0f : 0.0f);
+            setParameter(processor, "sync_division",       (float) random.nextInt(numDivisions));
+
+            const int numSamples = (int) jmin((int64) (1 + random.nextInt(maximumBlockSize)), numSamplesToProcess - position);
+
+            for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+            {
+                buffer.copyFrom(channel, 0, source, channel, 0, numSamples);
+
+                // In the sleep phase only the start of each burst period carries any input
+                if (isSleepPhase && (position - numSamplesToProcess / 2) % burstPeriod >= burstLength)
+                    buffer.clear(channel, 0, numSamples);
+            }
+
+            AudioBuffer<SampleType> hostBuffer(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), numSamples);
+
+            {
+                const RealtimeCheck::ScopedAudioCallback audioCallback;
+                processor.processBlock(hostBuffer, midi);
+            }
+
+            if (hostBuffer.getMagnitude(0, numSamples) == 0) { ++numSilentBlocks; }
+
+            position += numSamples;
+        }
+
+        processor.releaseResources();
+        return numSilentBlocks;
+    }
+
+    int runRealtimeChecks()
+    {
+        RealtimeCheck::initialise();
+
+        const int floatSilentBlocks     = runRealtimeCheck<float>(AudioProcessor::singlePrecision);
+        const int doubleSilentBlocks    = runRealtimeCheck<double>(AudioProcessor::doublePrecision);
+
+        if (const int numViolations = RealtimeCheck::getNumViolations())
+        {
+            cerr << "Real-time check failed: " << numViolations << " violation(s)" << endl;
+            return 1;
+        }
+
+        if (floatSilentBlocks == 0 || doubleSilentBlocks == 0)
+        {
+            cerr << "Real-time check failed: the engine never went to sleep" << endl;
+            return 1;
+        }
+
+        cout << "Real-time check passed: no allocations or locks in processBlock in either precision, "
+             << "through sleeping and waking (" << floatSilentBlocks << " / " << doubleSilentBlocks << " silent blocks)" << endl;
+        return 0;
+    }
+   #endif
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    ScopedJuceInitialiser_GUI juceInitialiser;
+    ArgumentList args(argc, argv);
+
+    if (args.containsOption("--engine-check"))
+        return runEngineChecks();
+
+    if (args.containsOption("--realtime-check"))
+    {
+       #if PINGPONG_REALTIME_CHECK
+        return runRealtimeChecks();
+       #else
+        cerr << "--realtime-check needs a build configured with -DPINGPONG_REALTIME_CHECK=ON" << endl;
+        return 1;
+       #endif
+    }
+
+    const double secondsOfAudio = args.containsOption("--seconds") ? args.getValueForOption("--seconds").getDoubleValue() : 2.0;
+
+    StringArray optionNames;
+    {
+        PingPongDelayAudioProcessor processor;
+        auto* choice = dynamic_cast<AudioParameterChoice*>(processor.parameters.getParameter("post_delay_option"));
+        jassert(choice != nullptr);
+        optionNames = choice->choices;
+    }
+
+    Array<var> results;
+
+    for (auto sampleRate : sampleRates)
+        for (auto blockSize : blockSizes)
+            for (int option = 0; option < optionNames.size(); ++option)
+                for (auto feedback : feedbackValues)
+                    for (int oversampling = 0; oversampling < (option == PostDelayOption::lowPassOption ? 1 : oversamplingOrders); ++oversampling)
+                    {
+                        const BenchmarkConfig config { sampleRate, blockSize, option, feedback, oversampling };
+                        results.add(toJson(config, runBenchmark(config, secondsOfAudio), optionNames));
+                    }
+
+    DynamicObject::Ptr root = new DynamicObject();
+    root->setProperty("benchmark",      "PingPongDelayAudioProcessor::processBlock");
+    root->setProperty("juceVersion",    SystemStats::getJUCEVersion());
+    root->setProperty("cpu",            SystemStats::getCpuModel());
+   #if JUCE_DEBUG
+    root->setProperty("build",          "Debug");
+   #else
+    root->setProperty("build",          "Release");
+   #endif
+    root->setProperty("secondsPerRun",  secondsOfAudio);
+    root->setProperty("construction",   measureConstruction());
+    root->setProperty("results",        results);
+    root->setProperty("subBlocks",      measureSubBlocks(secondsOfAudio));
+    root->setProperty("delayStorage",   measureDelayStorage(secondsOfAudio));
+    root->setProperty("loudness",       measureLoudness(secondsOfAudio));
+
+    const auto json = JSON::toString(var(root.get()));
+
+    if (args.containsOption("--output"))
+    {
+        const auto file = args.getFileForOption("--output");
+
+        if (! file.replaceWithText(json))
+        {
+            cerr << "Could not write " << file.getFullPathName() << endl;
+            return 1;
+        }
+    }
+    else
+    {
+        cout << json << endl;
+    }
+
+    return 0;
+}
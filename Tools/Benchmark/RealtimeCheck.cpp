@@ -0,0 +1,195 @@
+/*
+  ==============================================================================
+
+    Audio-thread allocation and lock detector (Linux/glibc).
+
+    The definitions below take precedence over the C library's because they
+    live in the executable. Each one forwards to the real implementation after
+    checking whether the calling thread is inside a ScopedAudioCallback. This
+    file deliberately does not use JUCE: everything here may run inside malloc.
+
+  ==============================================================================
+*/
+
+#include "RealtimeCheck.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <unistd.h>
+
+extern "C"
+{
+    void* __libc_malloc(size_t);
+    void* __libc_calloc(size_t, size_t);
+    void* __libc_realloc(void*, size_t);
+    void* __libc_memalign(size_t, size_t);
+    void  __libc_free(void*);
+}
+
+namespace
+{
+    using MutexLockFunction = int (*)(pthread_mutex_t*);
+
+    thread_local bool   isInsideAudioCallback   = false;
+    thread_local bool   isReporting             = false;
+    std::atomic<int>    numViolations { 0 };
+    MutexLockFunction   realMutexLock           = nullptr;
+
+    void writeToStderr(const char* text)
+    {
+        const auto unused = write(STDERR_FILENO, text, strlen(text));
+        (void) unused;
+    }
+
+    void reportViolation(const char* functionName)
+    {
+        if (! isInsideAudioCallback || isReporting) { return; }
+
+        // Reporting may itself allocate (e.g. the first backtrace() call), so it must not recurse
+        isReporting = true;
+        ++numViolations;
+
+        writeToStderr("Real-time violation: ");
+        writeToStderr(functionName);
+        writeToStderr(" called inside processBlock\n");
+
+        void* frames[64];
+        const int numFrames = backtrace(frames, 64);
+        backtrace_symbols_fd(frames, numFrames, STDERR_FILENO);
+        writeToStderr("\n");
+
+        isReporting = false;
+    }
+
+    MutexLockFunction getRealMutexLock()
+    {
+        if (realMutexLock == nullptr)
+            realMutexLock = reinterpret_cast<MutexLockFunction>(dlsym(RTLD_NEXT, "pthread_mutex_lock"));
+
+        return realMutexLock;
+    }
+}
+
+//==============================================================================
+namespace RealtimeCheck
+{
+    void initialise()
+    {
+        getRealMutexLock();
+
+        void* frames[4];
+        backtrace(frames, 4);
+    }
+
+    int getNumViolations()
+    {
+        return numViolations.load();
+    }
+
+    ScopedAudioCallback::ScopedAudioCallback()     { isInsideAudioCallback = true; }
+    ScopedAudioCallback::~ScopedAudioCallback()    { isInsideAudioCallback = false; }
+}
+
+//==============================================================================
+extern "C"
+{
+    void* malloc(size_t size)
+    {
+        reportViolation("malloc");
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t numElements, size_t size)
+    {
+        reportViolation("calloc");
+        return __libc_calloc(numElements, size);
+    }
+
+    void* realloc(void* pointer, size_t size)
+    {
+        reportViolation("realloc");
+        return __libc_realloc(pointer, size);
+    }
+
+    void* memalign(size_t alignment, size_t size)
+    {
+        reportViolation("memalign");
+        return __libc_memalign(alignment, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size)
+    {
+        reportViolation("aligned_alloc");
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** result, size_t alignment, size_t size)
+    {
+        reportViolation("posix_memalign");
+        *result = __libc_memalign(alignment, size);
+        return *result != nullptr ? 0 : ENOMEM;
+    }
+
+    void free(void* pointer)
+    {
+        // free(nullptr) does nothing, so it is allowed anywhere
+        if (pointer != nullptr) { reportViolation("free"); }
+        __libc_free(pointer);
+    }
+
+    int pthread_mutex_lock(pthread_mutex_t* mutex)
+    {
+        reportViolation("pthread_mutex_lock");
+        return getRealMutexLock()(mutex);
+    }
+}
+
+//==============================================================================
+namespace
+{
+    void* allocateForNew(size_t size, const char* functionName)
+    {
+        reportViolation(functionName);
+
+        if (auto* result = __libc_malloc(size == 0 ? 1 : size))
+            return result;
+
+        throw std::bad_alloc();
+    }
+
+    void* allocateAlignedForNew(size_t size, std::align_val_t alignment, const char* functionName)
+    {
+        reportViolation(functionName);
+
+        if (auto* result = __libc_memalign(static_cast<size_t>(alignment), size == 0 ? 1 : size))
+            return result;
+
+        throw std::bad_alloc();
+    }
+
+    void freeForDelete(void* pointer)
+    {
+        if (pointer != nullptr) { reportViolation("operator delete"); }
+        __libc_free(pointer);
+    }
+}
+
+void* operator new(size_t size)                                         { return allocateForNew(size, "operator new"); }
+void* operator new[](size_t size)                                       { return allocateForNew(size, "operator new[]"); }
+void* operator new(size_t size, std::align_val_t alignment)             { return allocateAlignedForNew(size, alignment, "operator new"); }
+void* operator new[](size_t size, std::align_val_t alignment)           { return allocateAlignedForNew(size, alignment, "operator new[]"); }
+
+void operator delete(void* pointer) noexcept                            { freeForDelete(pointer); }
+void operator delete[](void* pointer) noexcept                          { freeForDelete(pointer); }
+void operator delete(void* pointer, size_t) noexcept                    { freeForDelete(pointer); }
+void operator delete[](void* pointer, size_t) noexcept                  { freeForDelete(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept          { freeForDelete(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept        { freeForDelete(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept  { freeForDelete(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { freeForDelete(pointer); }
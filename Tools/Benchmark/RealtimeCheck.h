@@ -0,0 +1,30 @@
+/*
+  ==============================================================================
+
+    Audio-thread allocation and lock detector.
+
+    When the benchmark is built with PINGPONG_REALTIME_CHECK, malloc/free,
+    operator new/delete and pthread_mutex_lock are interposed. Any of them
+    called on a thread that is inside a ScopedAudioCallback is reported on
+    stderr together with a stack trace.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+namespace RealtimeCheck
+{
+    // Resolves the real functions and primes backtrace() so that neither allocates later on
+    void initialise();
+
+    // Number of violations reported since start-up
+    int getNumViolations();
+
+    // Marks the calling thread as being inside processBlock for the lifetime of the object
+    struct ScopedAudioCallback
+    {
+        ScopedAudioCallback();
+        ~ScopedAudioCallback();
+    };
+}
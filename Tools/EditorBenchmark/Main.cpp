@@ -0,0 +1,190 @@
+/*
+  ==============================================================================
+
+    Paints PingPongDelayAudioProcessorEditor off screen, frame after frame, with
+    the meters moving as they would under audio, and prints the time per frame
+    as JSON.
+
+    Every frame pushes a display frame's worth of meter levels into the
+    processor, lets the editor take them in as it does on each display refresh,
+    and paints either the whole editor or only the meters, which a host
+    repaints on every frame. "cached" is the editor's paint(), which copies its
+    pre-rendered background layer; "uncached" draws the background image,
+    frame and labels again every time, as paint() did before the layer.
+
+    Usage: PingPongDelayEditorBenchmark [--frames=<frames per run>] [--output=<file>]
+
+    Needs a build configured with -DPINGPONG_EDITOR_BENCHMARK=ON and the
+    editor's images (see CMakeLists.txt).
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/PluginProcessor.h"
+#include "../../Source/PluginEditor.h"
+
+using namespace juce;
+using namespace std;
+
+//==============================================================================
+struct EditorPaintBenchmark
+{
+    static constexpr double sampleRate      = 48000.0;
+    static constexpr double frameRate       = 60.0;
+    static constexpr int    numWarmUpFrames = 10;
+
+    // One display frame of output, at levels that sweep up and down so that the meters move on every frame
+    static void pushFrameOfLevels(MeterLevels& meterLevels, int frame)
+    {
+        const float seconds = (float) frame / (float) frameRate;
+
+        MeterLevels::Block block;
+        block.numSamples = (int) (sampleRate / frameRate);
+        block.sampleRate = sampleRate;
+
+        for (int channel = 0; channel < MeterLevels::numChannels; ++channel)
+        {
+            const float level = Decibels::decibelsToGain(-30.0f + 27.0f * sin(MathConstants<float>::twoPi * (0.5f * seconds + 0.25f * (float) channel)));
+
+            block.sumOfSquares[channel] = level * level * (float) block.numSamples;
+            block.peak[channel]         = jmin(1.0f, 1.4f * level);
+            block.truePeak[channel]     = jmin(1.0f, 1.5f * level);
+        }
+
+        block.momentaryLoudness     = -25.0f + 10.0f * sin(MathConstants<float>::twoPi * 0.5f * seconds);
+        block.shortTermLoudness     = -25.0f + 4.0f * sin(MathConstants<float>::twoPi * 0.1f * seconds);
+        block.integratedLoudness    = -23.0f + 2.0f * sin(MathConstants<float>::twoPi * 0.01f * seconds);
+
+        meterLevels.push(block);
+    }
+
+    // Paints what a host would repaint in area: the editor, with or without its cached layer, and the child
+    // components on top
+    static void paintFrame(PingPongDelayAudioProcessorEditor& editor, Graphics& g, Rectangle<int> area, bool cached)
+    {
+        Graphics::ScopedSaveState state(g);
+
+        if (! g.reduceClipRegion(area)) { return; }
+
+        if (cached)
+        {
+            editor.paintEntireComponent(g, false);
+            return;
+        }
+
+        editor.paintStaticLayer(g);
+
+        for (auto* child : editor.getChildren())
+        {
+            if (! child->isVisible()) { continue; }
+
+            Graphics::ScopedSaveState childState(g);
+            g.setOrigin(child->getPosition());
+
+            if (g.reduceClipRegion(child->getLocalBounds()))
+                child->paintEntireComponent(g, false);
+        }
+    }
+
+    // Average time to paint area in one frame, in microseconds
+    static double measureFrames(PingPongDelayAudioProcessorEditor& editor, MeterLevels& meterLevels, Rectangle<int> area,
+                                float scale, bool cached, int numFrames)
+    {
+        Image image(Image::ARGB, roundToInt((float) editor.getWidth() * scale), roundToInt((float) editor.getHeight() * scale), true);
+        double totalNs = 0.0;
+
+        for (int frame = -numWarmUpFrames; frame < numFrames; ++frame)
+        {
+            pushFrameOfLevels(meterLevels, frame + numWarmUpFrames);
+            editor.updateMeters(true);
+
+            const auto start = Time::getHighResolutionTicks();
+            {
+                Graphics g(image);
+                g.addTransform(AffineTransform::scale(scale));
+                paintFrame(editor, g, area, cached);
+            }
+            const auto end = Time::getHighResolutionTicks();
+
+            if (frame >= 0) { totalNs += Time::highResolutionTicksToSeconds(end - start) * 1.0e9; }
+        }
+
+        return totalNs / (double) numFrames / 1000.0;
+    }
+
+    static var run(int numFrames)
+    {
+        PingPongDelayAudioProcessor processor;
+        processor.setRateAndBufferSizeDetails(sampleRate, 512);
+        processor.prepareToPlay(sampleRate, 512);
+
+        PingPongDelayAudioProcessorEditor editor(processor);
+
+        const auto meterArea = editor.rmsMeterLeft.getBounds().getUnion(editor.rmsMeterRight.getBounds())
+                                                             .getUnion(editor.loudnessDisplay.getBounds());
+
+        const pair<const char*, Rectangle<int>> areas[] = { { "editor", editor.getLocalBounds() }, { "meters", meterArea } };
+
+        Array<var> entries;
+
+        for (auto scale : { 1.0f, 2.0f })
+        {
+            for (auto& [name, area] : areas)
+            {
+                const double uncachedUs = measureFrames(editor, processor.meterLevels, area, scale, false, numFrames);
+                const double cachedUs   = measureFrames(editor, processor.meterLevels, area, scale, true, numFrames);
+
+                DynamicObject::Ptr entry = new DynamicObject();
+                entry->setProperty("area",               name);
+                entry->setProperty("scale",              scale);
+                entry->setProperty("uncachedUsPerFrame", uncachedUs);
+                entry->setProperty("cachedUsPerFrame",   cachedUs);
+                entry->setProperty("speedup",            cachedUs > 0.0 ? uncachedUs / cachedUs : 0.0);
+                entries.add(var(entry.get()));
+            }
+        }
+
+        return entries;
+    }
+};
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    ScopedJuceInitialiser_GUI juceInitialiser;
+    ArgumentList args(argc, argv);
+
+    const int numFrames = args.containsOption("--frames") ? jmax(1, args.getValueForOption("--frames").getIntValue()) : 600;
+
+    DynamicObject::Ptr root = new DynamicObject();
+    root->setProperty("benchmark",      "PingPongDelayAudioProcessorEditor::paint");
+    root->setProperty("juceVersion",    SystemStats::getJUCEVersion());
+    root->setProperty("cpu",            SystemStats::getCpuModel());
+   #if JUCE_DEBUG
+    root->setProperty("build",          "Debug");
+   #else
+    root->setProperty("build",          "Release");
+   #endif
+    root->setProperty("framesPerRun",   numFrames);
+    root->setProperty("results",        EditorPaintBenchmark::run(numFrames));
+
+    const auto json = JSON::toString(var(root.get()));
+
+    if (args.containsOption("--output"))
+    {
+        const auto file = args.getFileForOption("--output");
+
+        if (! file.replaceWithText(json))
+        {
+            cerr << "Could not write " << file.getFullPathName() << endl;
+            return 1;
+        }
+    }
+    else
+    {
+        cout << json << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,320 @@
+/*
+  ==============================================================================
+
+    Offline renderer: runs PingPongDelayAudioProcessor (without its editor) over
+    audio files and writes the processed audio, including the delay tail.
+
+    Usage: PingPongDelayRender [options] <input files...>
+
+      --output-dir=<dir>     Where rendered files go (default: current directory).
+                             Each is named <input name>_pingpong.wav
+      --state=<file>         Saved plugin state, either the XML of the parameter
+                             tree or the binary blob from getStateInformation()
+      --params=<id=value,..> Parameter values, applied after --state
+      --threads=<n>          Number of workers (default: number of CPU cores)
+      --block-size=<n>       Host block size to simulate (default: 512)
+      --bits=<n>             Output bit depth (default: 24)
+      --max-tail=<seconds>   Upper limit on the rendered tail (default: 60)
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/PluginProcessor.h"
+
+using namespace juce;
+using namespace std;
+
+//==============================================================================
+namespace
+{
+    // The tail ends once the output stays below this level for longer than one delay repeat
+    const float tailSilenceThreshold = Decibels::decibelsToGain(-120.0f);
+
+    struct RenderSettings
+    {
+        File                                outputDirectory;
+        MemoryBlock                         state;
+        vector<pair<String, float>>         parameterValues;
+        int                                 blockSize       = 512;
+        int                                 bitsPerSample   = 24;
+        double                              maxTailSeconds  = 60.0;
+    };
+
+    // Shared between the workers: each one takes the next file until the list runs out
+    struct RenderQueue
+    {
+        Array<File>         inputFiles;
+        Array<File>         outputFiles;    // One for each input file, none of them an input file
+        atomic<int>         nextIndex { 0 };
+        atomic<int>         numFailed { 0 };
+        CriticalSection     outputLock;
+
+        void log(const String& message)
+        {
+            const ScopedLock sl(outputLock);
+            cout << message << endl;
+        }
+    };
+
+    bool loadState(const File& file, MemoryBlock& state)
+    {
+        if (auto xml = XmlDocument::parse(file))
+        {
+            AudioProcessor::copyXmlToBinary(*xml, state);
+            return true;
+        }
+
+        // Not XML, so expect the binary blob written by getStateInformation()
+        return file.loadFileAsData(state) && state.getSize() > 0;
+    }
+
+    bool parseParameterValues(const String& text, vector<pair<String, float>>& values)
+    {
+        for (auto& token : StringArray::fromTokens(text, ",", ""))
+        {
+            if (! token.contains("=")) { return false; }
+
+            values.emplace_back(token.upToFirstOccurrenceOf("=", false, false).trim(),
+                                token.fromFirstOccurrenceOf("=", false, false).getFloatValue());
+        }
+
+        return true;
+    }
+
+    //==============================================================================
+    class RenderWorker : public Thread
+    {
+    public:
+        RenderWorker(RenderQueue& queueToUse, const RenderSettings& settingsToUse)
+            : Thread("Render worker"), queue(queueToUse), settings(settingsToUse)
+        {
+            formatManager.registerBasicFormats();
+        }
+
+        ~RenderWorker() override
+        {
+            stopThread(10000);
+        }
+
+        void run() override
+        {
+            while (! threadShouldExit())
+            {
+                const int index = queue.nextIndex++;
+
+                if (index >= queue.inputFiles.size()) { break; }
+
+                const auto& inputFile = queue.inputFiles.getReference(index);
+                const auto result = renderFile(inputFile, queue.outputFiles.getReference(index));
+
+                if (result.wasOk())
+                {
+                    queue.log("Rendered " + inputFile.getFullPathName());
+                }
+                else
+                {
+                    ++queue.numFailed;
+                    queue.log("Failed " + inputFile.getFullPathName() + ": " + result.getErrorMessage());
+                }
+            }
+        }
+
+    private:
+        Result applySettings()
+        {
+            if (settings.state.getSize() > 0)
+                processor.setStateInformation(settings.state.getData(), (int) settings.state.getSize());
+
+            for (auto& [parameterID, value] : settings.parameterValues)
+            {
+                auto* parameter = processor.parameters.getParameter(parameterID);
+
+                if (parameter == nullptr) { return Result::fail("Unknown parameter " + parameterID); }
+
+                parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+            }
+
+            return Result::ok();
+        }
+
+        Result renderFile(const File& inputFile, const File& outputFile)
+        {
+            unique_ptr<AudioFormatReader> reader(formatManager.createReaderFor(inputFile));
+
+            if (reader == nullptr) { return Result::fail("Unsupported or unreadable file"); }
+
+            const auto applied = applySettings();
+
+            if (applied.failed()) { return applied; }
+
+            const double sampleRate = reader->sampleRate;
+            const int blockSize     = settings.blockSize;
+
+            // Preparing again for every file also clears whatever the previous file left in the delay line
+            processor.setNonRealtime(true);
+            processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+            processor.prepareToPlay(sampleRate, blockSize);
+
+            outputFile.deleteFile();
+
+            unique_ptr<OutputStream> stream(outputFile.createOutputStream());
+
+            if (stream == nullptr) { return Result::fail("Could not create " + outputFile.getFullPathName()); }
+
+            WavAudioFormat wavFormat;
+            unique_ptr<AudioFormatWriter> writer(wavFormat.createWriterFor(stream.get(), sampleRate, 2, settings.bitsPerSample, {}, 0));
+
+            if (writer == nullptr) { return Result::fail("Could not write " + outputFile.getFullPathName()); }
+
+            stream.release();   // Now owned by the writer
+
+            AudioBuffer<float> buffer(2, blockSize);
+            MidiBuffer midi;
+
+            // Drop the processor's latency (distortion oversampling) from the start of the output, so
+            // the rendered file lines up with the input
+            int64 samplesToSkip = processor.getLatencySamples();
+
+            auto writeBlock = [&](const AudioBuffer<float>& block, int numSamples)
+            {
+                const int skipped = (int) jmin((int64) numSamples, samplesToSkip);
+                samplesToSkip -= skipped;
+
+                return skipped == numSamples || writer->writeFromAudioSampleBuffer(block, skipped, numSamples - skipped);
+            };
+
+            // The input itself
+            for (int64 position = 0; position < reader->lengthInSamples; position += blockSize)
+            {
+                const int numSamples = (int) jmin((int64) blockSize, reader->lengthInSamples - position);
+
+                buffer.clear();
+                reader->read(&buffer, 0, numSamples, position, true, true);
+
+                if (reader->numChannels == 1) { buffer.copyFrom(1, 0, buffer, 0, 0, numSamples); }
+
+                AudioBuffer<float> block(buffer.getArrayOfWritePointers(), 2, numSamples);
+                processor.processBlock(block, midi);
+
+                if (! writeBlock(block, numSamples)) { return Result::fail("Write error"); }
+            }
+
+            // Then silence until the repeats have died away. Repeats can be a full delay time apart,
+            // so the output has to stay quiet for longer than that before the tail counts as finished.
+            // The snapshot holds the delay the engine runs at, which is the synced one when "sync" is on
+            const float delayTime       = jmin(processor.getParameterSnapshot().delayTime,
+                                               processor.parameters.getParameterRange("delayTime").end);
+            const int64 silenceNeeded   = (int64) (delayTime * sampleRate) + blockSize;
+            const int64 maxTailSamples  = (int64) (settings.maxTailSeconds * sampleRate);
+
+            int64 silentSamples = 0;
+
+            for (int64 tailSamples = 0; tailSamples < maxTailSamples && silentSamples < silenceNeeded; tailSamples += blockSize)
+            {
+                buffer.clear();
+                processor.processBlock(buffer, midi);
+
+                if (! writeBlock(buffer, blockSize)) { return Result::fail("Write error"); }
+
+                const float peak = jmax(buffer.getMagnitude(0, 0, blockSize), buffer.getMagnitude(1, 0, blockSize));
+                silentSamples = peak < tailSilenceThreshold ? silentSamples + blockSize : 0;
+            }
+
+            processor.releaseResources();
+            return Result::ok();
+        }
+
+        RenderQueue&                    queue;
+        const RenderSettings&           settings;
+        AudioFormatManager              formatManager;
+        PingPongDelayAudioProcessor     processor;      // One instance per worker, reused for each file
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RenderWorker)
+    };
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    ScopedJuceInitialiser_GUI juceInitialiser;
+    ArgumentList args(argc, argv);
+
+    RenderSettings settings;
+    RenderQueue queue;
+
+    for (auto& argument : args.arguments)
+        if (! argument.isOption())
+            queue.inputFiles.add(File::getCurrentWorkingDirectory().getChildFile(argument.text));
+
+    if (queue.inputFiles.isEmpty())
+    {
+        cerr << "Usage: PingPongDelayRender [--output-dir=<dir>] [--state=<file>] [--params=<id=value,...>] "
+                "[--threads=<n>] [--block-size=<n>] [--bits=<n>] [--max-tail=<seconds>] <input files...>" << endl;
+        return 1;
+    }
+
+    settings.outputDirectory = args.containsOption("--output-dir") ? args.getFileForOption("--output-dir")
+                                                                   : File::getCurrentWorkingDirectory();
+
+    if (! settings.outputDirectory.createDirectory())
+    {
+        cerr << "Could not create " << settings.outputDirectory.getFullPathName() << endl;
+        return 1;
+    }
+
+    // Rendered files are deleted and written from scratch, so make sure none of them is one of the inputs,
+    // and that no two inputs would be rendered to the same file
+    for (auto& inputFile : queue.inputFiles)
+    {
+        const auto outputFile = settings.outputDirectory.getChildFile(inputFile.getFileNameWithoutExtension() + "_pingpong.wav");
+
+        if (queue.inputFiles.contains(outputFile))
+        {
+            cerr << "Rendering " << inputFile.getFullPathName() << " would overwrite the input file "
+                 << outputFile.getFullPathName() << endl;
+            return 1;
+        }
+
+        if (const int other = queue.outputFiles.indexOf(outputFile); other >= 0)
+        {
+            cerr << inputFile.getFullPathName() << " and " << queue.inputFiles[other].getFullPathName()
+                 << " would both be rendered to " << outputFile.getFullPathName() << endl;
+            return 1;
+        }
+
+        queue.outputFiles.add(outputFile);
+    }
+
+    if (args.containsOption("--state") && ! loadState(args.getExistingFileForOption("--state"), settings.state))
+    {
+        cerr << "Could not read the state file" << endl;
+        return 1;
+    }
+
+    if (args.containsOption("--params") && ! parseParameterValues(args.getValueForOption("--params"), settings.parameterValues))
+    {
+        cerr << "--params expects a comma separated list of id=value pairs" << endl;
+        return 1;
+    }
+
+    if (args.containsOption("--block-size"))   { settings.blockSize       = jmax(1, args.getValueForOption("--block-size").getIntValue()); }
+    if (args.containsOption("--bits"))         { settings.bitsPerSample   = args.getValueForOption("--bits").getIntValue(); }
+    if (args.containsOption("--max-tail"))     { settings.maxTailSeconds  = jmax(0.0, args.getValueForOption("--max-tail").getDoubleValue()); }
+
+    const int numThreads = args.containsOption("--threads") ? jmax(1, args.getValueForOption("--threads").getIntValue())
+                                                            : SystemStats::getNumCpus();
+
+    OwnedArray<RenderWorker> workers;
+
+    for (int i = 0; i < jmin(numThreads, queue.inputFiles.size()); ++i)
+        workers.add(new RenderWorker(queue, settings))->startThread();
+
+    for (auto* worker : workers)
+        worker->waitForThreadToExit(-1);
+
+    const int numFailed = queue.numFailed.load();
+    cout << (queue.inputFiles.size() - numFailed) << " of " << queue.inputFiles.size() << " files rendered" << endl;
+
+    return numFailed == 0 ? 0 : 1;
+}